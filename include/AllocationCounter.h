@@ -0,0 +1,30 @@
+#ifndef TYGLADIG_ALLOCATIONCOUNTER_H
+#define TYGLADIG_ALLOCATIONCOUNTER_H
+
+// Counts the heap allocations made through operator new on every thread, so checks can verify
+// that a loop allocates nothing once it runs. Compiled in when TYGLADIG_COUNT_ALLOCATIONS is
+// defined, which debug builds do (cmake -DTYGLADIG_COUNT_ALLOCATIONS=ON turns it on for others).
+//
+//   uint64_t before = ALLOCATION_COUNT();
+//   ... loop ...
+//   uint64_t allocations = ALLOCATION_COUNT() - before;
+
+#include <cstdint>
+
+#ifdef TYGLADIG_COUNT_ALLOCATIONS
+
+class AllocationCounter {
+public:
+    // Allocations since the program started
+    static uint64_t getCount();
+};
+
+#define ALLOCATION_COUNT() AllocationCounter::getCount()
+
+#else
+
+#define ALLOCATION_COUNT() ((uint64_t)0)
+
+#endif //TYGLADIG_COUNT_ALLOCATIONS
+
+#endif //TYGLADIG_ALLOCATIONCOUNTER_H
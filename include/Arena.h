@@ -0,0 +1,70 @@
+#ifndef TYGLADIG_ARENA_H
+#define TYGLADIG_ARENA_H
+
+#include <vector>
+#include <cstddef>
+
+// A linear allocator for scratch memory that only lives until the next reset, such as the per
+// block sums and the lists of a simulation step. Allocating moves a pointer through one buffer
+// and reset frees everything at once.
+//
+// When the buffer is full, allocations fall back to the heap and the next reset grows the buffer
+// to the most that was needed, so a loop with the same needs every iteration stops allocating
+// after its first pass. Sized for the largest need up front it never allocates at all.
+class Arena {
+public:
+    struct Marker {
+        size_t used;
+        size_t overflowCount;
+        size_t overflowBytes;
+    };
+
+    Arena(size_t theCapacity = 0);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Uninitialised memory for count objects of a trivial type
+    template <typename T>
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void* allocate(size_t bytes, size_t alignment);
+
+    // Frees everything allocated since the last reset
+    void reset();
+
+    // Frees everything allocated since getMarker returned marker
+    Marker getMarker();
+    void rewind(Marker marker);
+
+    // Grows the buffer to at least capacity bytes, only while nothing is allocated from it
+    void reserve(size_t capacity);
+
+    size_t getCapacity();
+
+private:
+    char* buffer;
+    size_t capacity;
+    size_t used;
+    size_t peak;                 // most bytes in use since the last reset, overflow included
+    std::vector<void*> overflow; // heap blocks taken while the buffer was full
+    size_t overflowBytes;
+};
+
+// Rewinds an arena to where it was when the scope was entered
+class ArenaScope {
+public:
+    ArenaScope(Arena& theArena) : arena(theArena), marker(theArena.getMarker()) {}
+    ~ArenaScope() {
+        arena.rewind(marker);
+    }
+
+private:
+    Arena& arena;
+    Arena::Marker marker;
+};
+
+#endif //TYGLADIG_ARENA_H
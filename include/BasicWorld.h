@@ -0,0 +1,189 @@
+#ifndef TYGLADIG_BASICWORLD_H
+#define TYGLADIG_BASICWORLD_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+#include "World.h"
+#include "Arena.h"
+#include "Multigrid.h"
+#include "SparseCholesky.h"
+#include "UninitialisedVector.h"
+
+// The simulation of World with the particles, springs and wind kept in Real and the forces of a
+// particle, the energies and the right hand sides of the solvers summed in Sum. Instantiated in
+// World.cpp for float and float, double and double, and float and double (mixed).
+//
+// The multigrid and Cholesky solvers keep float vectors in every precision, they already form
+// their dot products and factors in double, and the projective solve is for the moves of a
+// step, which float holds well even when the positions need double.
+template <typename Real, typename Sum>
+class BasicWorld : public World {
+public:
+    typedef glm::tvec3<Real, glm::highp> Vec3;
+    typedef glm::tvec3<Sum, glm::highp> SumVec3;
+
+    BasicWorld(const Scene& theScene);
+    BasicWorld(const Scene& theScene, GLuint firstRow, GLuint rowCount);
+
+    void setThreadPool(ThreadPool* thePool);
+    void step(bool push);
+    void substep(bool push);
+    GLuint getClothCount();
+    const Cloth& getCloth(GLuint cloth);
+    GLuint getParticleCount();
+    const std::vector<GLuint>& getIndices();
+    void takeChangedTriangles(std::vector<GLuint>& triangles);
+    void setPinned(GLuint particle, bool isPinned);
+    bool isPinned(GLuint particle);
+    GLuint getSpringCount();
+    void getPositions(GLfloat* positions);
+    GLfloat getEnergy();
+    GLfloat getEnergyScale();
+    GLfloat getMaxStrain();
+    GLfloat getFrameTime();
+    GLuint getIterations();
+    void getStates(GLuint first, GLuint count, GLfloat* states);
+    void setStates(GLuint first, GLuint count, const GLfloat* states);
+    GLfloat getRestLengthError();
+    size_t getSpringBytes();
+
+private:
+    // A spring and damper between particles a and b, 12 bytes. The constants of the spring are
+    // those of its material, and its rest length is quantisedLength times the world's length
+    // quantum, or kept exactly in restLengths when rest lengths are not quantised.
+    struct Spring {
+        GLuint a, b;
+        GLushort quantisedLength;
+        GLushort material : 13; // index in the world's materials
+        GLushort type : 2;      // SpringType
+        GLushort alive : 1;     // 0 once torn
+    };
+
+    Scene scene;
+    std::vector<Cloth> cloths;
+    std::vector<Material> materials; // one per cloth of the scene, shared by its copies
+    GLuint springCount; // springs that have not been torn
+    Real energyScale;
+    ThreadPool* pool;
+    Real time; // simulated time
+
+    // Particles, one element per particle in every array
+    UninitialisedVector<Vec3> positions, velocities, accelerations;
+    UninitialisedVector<Real> masses, inverseMasses;
+    UninitialisedVector<unsigned char> pinned, pushed; // pushed marks the middle particle of every cloth
+
+    // With the particles in Morton order, the number every particle has in the queries of World,
+    // the particle of every number and the triangle list in those numbers. All three are empty in
+    // grid order, where a particle's number is its index.
+    std::vector<GLuint> particleNumbers, particleIndices, numberedIndices;
+    GLuint orderedCount; // particles when they were last put in order
+
+    std::vector<GLuint> indices;
+    UninitialisedVector<Spring> springs;
+    UninitialisedVector<Real> restLengths; // per spring, empty with quantised rest lengths
+    Real lengthQuantum;            // 0 with exact rest lengths
+    Real restLengthError;          // largest relative error of a quantised rest length
+    UninitialisedVector<Vec3> springForces, dampForces; // on particle a of every spring, b gets the opposite
+
+    // The springs and triangles of every particle, as segments of a shared list. When a particle
+    // splits, its segments are divided in place between it and the particles split off it.
+    UninitialisedVector<GLuint> vertexSpringStart, vertexSpringCount, vertexSprings;
+    UninitialisedVector<GLuint> vertexTriangleStart, vertexTriangleCount, vertexTriangles;
+
+    // Quadratic bending. The bending energy of all cloths is half the quadratic form of the
+    // positions with one constant matrix, its Hessian, which is assembled when the scene is set
+    // up. A bending force is then a row of one sparse product, multiply-adds over the positions
+    // with no square root or normalisation. The product is of the positions plus the velocities
+    // times the b / k of the particle's material, which damps the bending as the dampers of the
+    // springs damp their stretch. The vectors are kept one array per coordinate for the product.
+    SlicedMatrix bendingMatrix;
+    UninitialisedVector<Real> bendDamping;                        // per particle
+    UninitialisedVector<Real> bendInputX, bendInputY, bendInputZ; // positions plus damped velocities
+    UninitialisedVector<Real> bendForceX, bendForceY, bendForceZ;
+
+    // Springs past the tear strain, BLOCK_SIZE slots for every block of springs and how many are used
+    UninitialisedVector<GLuint> tornSprings;
+    std::vector<GLuint> tornCounts;
+    std::vector<GLuint> changedTriangles;
+    std::vector<bool> triangleChanged;
+
+    // Wind. The edges and relative wind of every triangle are gathered into flat arrays, one per
+    // coordinate, the aerodynamic forces are computed over those and then summed by the vertices
+    // in a fixed order.
+    UninitialisedVector<Real> edge1X, edge1Y, edge1Z;              // per triangle
+    UninitialisedVector<Real> edge2X, edge2Y, edge2Z;
+    UninitialisedVector<Real> relativeX, relativeY, relativeZ;     // wind relative to the triangle
+    UninitialisedVector<Real> aeroX, aeroY, aeroZ;                 // force on each vertex of the triangle
+    UninitialisedVector<Vec3> windForces;                          // per particle
+
+    // Tethers, the pinned particle nearest to every particle along the springs and the rest
+    // length of that path. UINT32_MAX for particles no pin is connected to.
+    UninitialisedVector<GLuint> tetherAnchors;
+    UninitialisedVector<Real> tetherLengths;
+    std::vector<std::pair<Real, GLuint>> tetherQueue; // of the search, sized once
+
+    // Implicit solver
+    Multigrid multigrid;
+    std::vector<glm::vec3> implicitRhs, velocityChanges;
+    GLuint iterations;
+
+    // Adaptive steps: the state before the last step, to take it back, and the size of the next
+    std::vector<Vec3> savedPositions, savedVelocities, savedAccelerations;
+    Real shortestRestLength, adaptiveSize;
+    bool forcesValid, forcesPush; // the accelerations belong to the current state and push
+
+    // Projective solver
+    SparseCholesky cholesky;
+    std::vector<Vec3> previousPositions, springProjections, inertialRhs;
+    std::vector<glm::vec3> projectiveRhs;
+
+    Arena scratch;
+
+    // Runs work(begin, end) for every block of [0, count)
+    void forEachBlock(GLuint count, BlockFunction work);
+
+    void placeOnNodes();
+
+    void build(GLuint firstRow);
+    void addCloth(const ClothSettings& settings, GLuint material, glm::vec3 corner, GLuint firstRow);
+    void addMesh(const ClothSettings& settings, GLuint material, glm::vec3 corner);
+    GLuint addParticle(Vec3 position, Vec3 velocity, Real mass, bool isPinned);
+    void addSpring(GLuint a, GLuint b, Real restLength, SpringType type, GLuint material);
+    Real restLength(GLuint spring);
+    GLuint particleNumber(GLuint particle);
+    GLuint particleIndex(GLuint number);
+    void reorder();
+    void buildBending();
+
+    Vec3 windAt(Vec3 position);
+    void computeWind();
+
+    SumVec3 particleForce(GLuint index, bool push);
+    SumVec3 outerForce(GLuint index, bool push);
+    void computeForces(bool push);
+    void tear();
+    void splitParticle(GLuint particle);
+    bool hasSpring(GLuint particle, GLuint other);
+    void integrate(Real h);
+    void adaptiveFrame(bool push);
+    Real largestDifference(const Vec3* a, const Vec3* b);
+    void findTethers();
+    void applyTethers();
+    SparseMatrix buildSystemMatrix();
+    void buildImplicit();
+    void solveImplicit();
+    void buildProjective();
+    void solveProjective(bool push);
+    void collide();
+};
+
+#endif //TYGLADIG_BASICWORLD_H
@@ -0,0 +1,54 @@
+#ifndef TYGLADIG_CLOTHMESH_H
+#define TYGLADIG_CLOTHMESH_H
+
+#include <string>
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+#include "World.h"
+
+// A cloth read from a triangle mesh, a Wavefront OBJ file or a PLY file in ASCII or binary, such
+// as a garment. Polygons are cut into fans of triangles. The springs come from the adjacency of
+// the mesh: a structural spring along every edge of a polygon, a shear spring along every
+// diagonal a fan cuts a polygon along and between the two corners across it, and a bend spring
+// between the corners across every other edge two triangles share, which resists folding there.
+//
+// The file is mapped into memory and parsed on the threads of a pool. Text is cut into chunks at
+// line breaks, a first pass counts the lines, vertices and triangles of every chunk and a second
+// one parses every chunk into its place in the arrays. Binary PLY records are parsed in blocks,
+// a quick pass over the counts of the faces finds where every block of faces starts. The springs
+// are found by sorting the edges by their lower vertex, in time linear in the size of the mesh.
+class ClothMesh {
+public:
+    struct Spring {
+        GLuint a, b; // a < b
+        SpringType type;
+    };
+
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> indices; // triangle list
+    std::vector<Spring> springs;
+    glm::vec3 lowest, highest;   // corners of the bounding box
+    GLuint middle;               // the vertex nearest the centre of the bounding box
+    GLfloat longestSpring;
+
+    // Reads a .obj or .ply file on threadCount threads, zero for one per hardware thread. Returns
+    // false after a message on std::cerr if the file cannot be read or is not a usable mesh.
+    bool read(std::string fileName, GLuint threadCount = 0);
+
+private:
+    std::vector<unsigned char> diagonals; // bit c of a triangle: its edge from corner c is a diagonal
+
+    bool readObj(const std::string& fileName, const char* begin, const char* end, ThreadPool& pool);
+    bool readPly(const std::string& fileName, const char* begin, const char* end, ThreadPool& pool);
+    void addPolygon(const GLuint* corners, GLuint count, size_t triangle);
+    bool findSprings(const std::string& fileName);
+};
+
+#endif //TYGLADIG_CLOTHMESH_H
@@ -0,0 +1,120 @@
+#ifndef TYGLADIG_DECOMPOSITION_H
+#define TYGLADIG_DECOMPOSITION_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "Scene.h"
+
+// A single producer, single consumer queue of fixed size messages in memory shared between two
+// processes. The ring only holds offsets into its own memory, so every process can map it anywhere.
+class SharedRing {
+public:
+    // Bytes of shared memory a ring of slotCount messages of messageBytes needs
+    static size_t getSize(GLuint slotCount, size_t messageBytes);
+
+    // Sets up an empty ring in memory, once, before the processes using it are started
+    static void create(void* memory, GLuint slotCount, size_t messageBytes);
+
+    SharedRing(void* memory);
+
+    // The slot of the next message, which must be written before calling push. Null when the
+    // ring stays full until abort is set.
+    void* beginPush(const std::atomic<uint32_t>& abort);
+    void push();
+
+    // The oldest message, which must be read before calling pop. Null when the ring stays empty
+    // until abort is set.
+    const void* beginPop(const std::atomic<uint32_t>& abort);
+    void pop();
+
+private:
+    // The producer writes head and the consumer tail, on cache lines of their own
+    struct Header {
+        alignas(64) std::atomic<uint64_t> head; // messages ever pushed
+        alignas(64) std::atomic<uint64_t> tail; // messages ever popped
+        GLuint slotCount;
+        size_t messageBytes;
+    };
+
+    Header* header;
+    unsigned char* slots;
+};
+
+// Simulates the single cloth of a scene in several processes, each holding only a band of rows.
+//
+// The coordinator, the process creating the decomposition, forks one worker per band. A worker
+// simulates its rows together with the two rows on either side it shares with its neighbours,
+// which is as far as a spring reaches. After every substep it sends its two outermost rows to
+// each neighbour and takes their rows in return, through a ring in POSIX shared memory per
+// direction, so the particles of its own rows get exactly the forces they get in one process.
+//
+// The coordinator drives the workers frame by frame: step releases the next frame and waits at
+// the step barrier until every worker has written its rows of that frame to the shared state.
+// Workers that crash or are killed are noticed there, the remaining ones are stopped and step
+// fails, so a long run ends with an error instead of hanging or taking the coordinator down.
+//
+// The shared memory is unlinked as soon as it is mapped, nothing is left behind whatever happens
+// to the processes.
+class Decomposition {
+public:
+    static const GLuint GHOST_ROWS = 2;
+    static const GLuint RING_SLOTS = 4;
+
+    Decomposition(const Scene& theScene, GLuint theProcessCount);
+    ~Decomposition();
+
+    // Checks that the scene can be split into the bands and prints why if not. Only scenes with a
+    // single cloth that does not tear can be split, into bands of at least GHOST_ROWS rows.
+    bool canSplit();
+
+    // Checks that the scene can be split, maps the shared memory and starts the workers
+    bool start();
+
+    // Simulates one frame in every band, false if a worker failed
+    bool step();
+
+    // Stops the workers and waits for them
+    void stop();
+
+    GLuint getProcessCount();
+    GLuint getParticleCount();
+
+    // Position and velocity of every particle after the last step, as World::getStates writes them
+    const GLfloat* getStates();
+
+    // Same as World::getStateHash of a world simulating the whole cloth
+    uint64_t getStateHash();
+
+private:
+    struct Control {
+        std::atomic<uint32_t> frames;   // frames the workers are allowed to simulate
+        std::atomic<uint32_t> stopping; // set when the workers have to exit
+    };
+
+    Scene scene;
+    GLuint processCount;
+    GLuint width, height;
+    GLuint frame;
+
+    void* memory;
+    size_t memoryBytes;
+    Control* control;
+    std::atomic<uint32_t>* framesDone; // per worker, frames written to the states
+    std::vector<size_t> ringOffsets;   // ring 2b goes down from band b, ring 2b+1 up to it
+    GLfloat* states;
+    std::vector<int> workers;          // process ids, 0 once a worker has exited
+
+    GLuint getFirstRow(GLuint band);
+    void* getRing(GLuint ring);
+    void runWorker(GLuint band);
+    bool checkWorkers();
+};
+
+#endif //TYGLADIG_DECOMPOSITION_H
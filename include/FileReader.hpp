@@ -5,4 +5,7 @@
 class FileReader {
 public:
     static const std::string ReadFromFile(std::string fileName);
+
+    /// Creates the directory if it does not exist yet, returns false if it could not be created
+    static bool MakeDirectory(std::string directory);
 };
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef TYGLADIG_FRAMECACHE_H
+#define TYGLADIG_FRAMECACHE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// A frame cache is a directory holding the simulated particle positions of every frame:
+//   cache.info       - particle count, frames per chunk, error bound and total number of frames
+//   chunk_00000.bin  - the xyz positions of framesPerChunk consecutive frames, encoded by FrameCodec
+// Frames are collected into chunks on the simulation thread and compressed and written to disk
+// by a background thread, so appending a frame does not wait for the disk. When the disk falls
+// behind, chunks queue up in new buffers up to MAX_BUFFERS, after which appending waits for the
+// writer instead of dropping frames or growing further, and close reports how often it did.
+
+class FrameCacheWriter {
+public:
+    // Most chunk buffers, filled, queued or being written, the writer ever holds
+    static const GLuint MAX_BUFFERS = 8;
+
+    // Positions are stored within errorBound of the simulated ones, zero stores them exactly
+    FrameCacheWriter(std::string theDirectory, GLuint theParticleCount, GLfloat theErrorBound = 0.0001f,
+                     GLuint theFramesPerChunk = 64);
+    ~FrameCacheWriter();
+
+    // Copies 3 * particleCount floats (x, y, z per particle) into the cache
+    void append(const GLfloat* positions);
+
+    // Writes the last partial chunk and the cache header, waits for the writer thread
+    void close();
+
+    bool isOpen();
+    GLuint getFrameCount();
+
+private:
+    struct Chunk {
+        GLuint index;
+        GLuint frameCount;
+        std::vector<GLfloat> positions;
+    };
+
+    std::string directory;
+    GLuint particleCount;
+    GLfloat errorBound;
+    GLuint framesPerChunk;
+    GLuint frameCount;
+    bool open;
+
+    // The chunk being filled by the simulation thread
+    Chunk current;
+
+    // Full chunks waiting for the writer thread, and emptied buffers it hands back
+    std::deque<Chunk> pending;
+    std::vector<std::vector<GLfloat>> freeBuffers;
+    GLuint bufferCount; // allocated, at most MAX_BUFFERS
+    GLuint stalls;      // times append waited for a free buffer
+    bool stopping;
+    bool writeFailed;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::condition_variable bufferFreed;
+    std::thread writer;
+
+    void startChunk(GLuint index);
+    void submitChunk();
+    void writerLoop();
+    bool writeChunk(const Chunk& chunk);
+    bool writeInfo();
+};
+
+class FrameCacheReader {
+public:
+    FrameCacheReader(std::string theDirectory);
+    ~FrameCacheReader();
+
+    bool isOpen();
+    GLuint getParticleCount();
+    GLuint getFrameCount();
+
+    // Returns the 3 * particleCount positions of a frame, or nullptr if it could not be read.
+    // The pointer stays valid until the next call.
+    const GLfloat* getFrame(GLuint frame);
+
+private:
+    std::string directory;
+    GLuint particleCount;
+    GLuint framesPerChunk;
+    GLuint frameCount;
+    bool open;
+
+    GLint loadedChunk;
+    std::vector<GLfloat> chunkPositions;
+
+    // The chunk after the loaded one is read in the background during playback
+    GLint prefetchedChunk;
+    std::future<std::vector<GLfloat>> prefetch;
+
+    std::vector<GLfloat> readChunk(GLuint chunk);
+};
+
+#endif //TYGLADIG_FRAMECACHE_H
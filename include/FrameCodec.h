@@ -0,0 +1,38 @@
+#ifndef TYGLADIG_FRAMECODEC_H
+#define TYGLADIG_FRAMECODEC_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Lossy-but-bounded compression of a chunk of frames for the frame cache.
+// Positions are quantised on a grid of spacing 2 * errorBound inside the bounding box of the
+// chunk, every frame is delta encoded against the previous one and the deltas are Rice coded
+// in small blocks. Quantised values are stored one axis plane at a time so that, apart from the
+// bit reading, decoding is made of flat loops over contiguous arrays. The bit reading stays
+// scalar, one code at a time, but takes each code from a 64 bit window with one count of the
+// ones at its bottom and one mask instead of going bit by bit.
+
+class FrameCodec {
+public:
+    // Encodes frameCount frames of 3 * particleCount positions (x, y, z per particle).
+    // An errorBound of zero or less stores the positions uncompressed, and so does a chunk whose
+    // positions are too far from the origin for floats to keep within errorBound of them.
+    static void encode(const GLfloat* positions, GLuint particleCount, GLuint frameCount,
+                       GLfloat errorBound, std::vector<unsigned char>& out);
+
+    // Decodes a chunk written by encode, returns false if the data is corrupt or holds more than
+    // maxFrames frames
+    static bool decode(const unsigned char* data, size_t size, GLuint particleCount, GLuint maxFrames,
+                       std::vector<GLfloat>& positions);
+
+private:
+    static void encodeRice(const uint32_t* values, size_t count, std::vector<unsigned char>& out);
+    static bool decodeRice(const unsigned char* data, size_t size, uint32_t* values, size_t count);
+};
+
+#endif //TYGLADIG_FRAMECODEC_H
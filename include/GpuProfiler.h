@@ -0,0 +1,39 @@
+#ifndef TYGLADIG_GPUPROFILER_H
+#define TYGLADIG_GPUPROFILER_H
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "Profiler.h"
+
+// Measures the GPU time between begin and end with timestamp queries and records it in the
+// profiler as PHASE_GPU samples on a track of its own. The queries are read a few frames later,
+// when the GPU has long finished them, so measuring never stalls the render loop. Without
+// TYGLADIG_PROFILING every method does nothing.
+class GpuProfiler {
+public:
+    // Needs a current OpenGL context
+    GpuProfiler();
+    ~GpuProfiler();
+
+    void begin();
+    void end();
+
+    // Records the spans whose queries have finished, call once per frame
+    void collect();
+
+private:
+    static const GLuint LATENCY = 4; // frames in flight
+
+#ifdef TYGLADIG_PROFILING
+    GLuint queries[LATENCY][2];
+    uint32_t frames[LATENCY];
+    bool pending[LATENCY];
+    GLuint current;
+    int64_t offset; // profiler time minus GPU time, in nanoseconds
+    ProfileBuffer* buffer;
+#endif
+};
+
+#endif //TYGLADIG_GPUPROFILER_H
@@ -0,0 +1,72 @@
+#ifndef TYGLADIG_MESHEXPORTER_H
+#define TYGLADIG_MESHEXPORTER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+enum MeshFormat {
+    MESH_PLY, // Binary little endian PLY
+    MESH_OBJ  // Wavefront OBJ text
+};
+
+// Writes the cloth of every submitted frame as a mesh file (cloth_00000.ply, cloth_00001.ply, ...).
+// Submitting only copies the positions into a recycled buffer, formatting and writing the files
+// is done by a pool of writer threads. The buffers, one per writer and queueCapacity more, are
+// allocated once and bound the frames in flight. When all of them are taken, submit skips the
+// frame instead of waiting, so a disk that cannot keep up loses frames, which close reports, but
+// neither holds up the simulation nor uses up memory.
+
+class MeshExporter {
+public:
+    MeshExporter(std::string theDirectory, MeshFormat theFormat, std::vector<GLuint> theIndices,
+                 GLuint theParticleCount, GLuint workerCount = 2, GLuint queueCapacity = 8);
+    ~MeshExporter();
+
+    // Queues 3 * particleCount positions (x, y, z per particle) to be written as the given frame
+    void submit(GLuint frame, const GLfloat* positions);
+
+    // Writes all queued frames and stops the writer threads
+    void close();
+
+    bool isOpen();
+
+    // Parses "ply" or "obj", returns false for anything else
+    static bool parseFormat(std::string name, MeshFormat& format);
+
+private:
+    struct Job {
+        GLuint frame;
+        std::vector<GLfloat> positions;
+    };
+
+    std::string directory;
+    MeshFormat format;
+    std::vector<GLuint> indices;
+    GLuint particleCount;
+    bool open;
+
+    std::deque<Job> queue;
+    std::vector<std::vector<GLfloat>> freeBuffers;
+    bool stopping;
+    GLuint skippedFrames;
+    GLuint failures;
+
+    std::mutex queueMutex;
+    std::condition_variable jobQueued;
+    std::vector<std::thread> workers;
+
+    void workerLoop();
+    bool writePly(const Job& job, std::vector<char>& buffer);
+    bool writeObj(const Job& job, std::vector<char>& buffer);
+    std::string framePath(GLuint frame);
+};
+
+#endif //TYGLADIG_MESHEXPORTER_H
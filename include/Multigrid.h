@@ -0,0 +1,92 @@
+#ifndef TYGLADIG_MULTIGRID_H
+#define TYGLADIG_MULTIGRID_H
+
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+#include "Scene.h"
+#include "SparseMatrix.h"
+#include "ThreadPool.h"
+
+// A rectangular grid of unknowns, numbered row by row from first
+struct GridLayout {
+    GLuint first;
+    GLuint width, height;
+};
+
+// Solves a symmetric positive definite system whose unknowns are the nodes of regular grids, such
+// as the particles of the cloths, with conjugate gradients and a geometric multigrid hierarchy.
+//
+// Every level coarsens each grid by two along every side that has more than two nodes, keeping
+// the nodes with even row and column. Prolongation interpolates bilinearly from the coarse
+// nodes, restriction is its transpose (full weighting), and the matrix of a coarser level is
+// restriction * matrix * prolongation of the finer one. The levels stop when the coarsest
+// fits a dense Cholesky factorisation.
+//
+// A V-cycle smooths the high frequencies of the error with l1 Jacobi sweeps on the way down
+// and up, and the coarser levels remove the low frequencies that take an unpreconditioned solver
+// a number of iterations growing with the grid size. Used as the preconditioner of conjugate
+// gradients or as a solver on its own, the iterations needed stay about the same for any size.
+//
+// Everything is sized by build, solving allocates nothing. The rows are processed in fixed blocks
+// and sums formed in block order, so the results do not depend on the thread pool.
+class Multigrid {
+public:
+    static const GLuint BLOCK_SIZE = 256;
+    static const GLuint SMOOTHING_SWEEPS = 2;
+    static const GLuint MAX_COARSEST = 1024; // unknowns the dense coarsest level may have
+
+    Multigrid();
+
+    // Builds the levels for matrix, whose unknowns are the nodes of grids. The rows of fixed
+    // unknowns must be rows of the identity, their solution is always zero.
+    void build(const SparseMatrix& matrix, const std::vector<GridLayout>& grids,
+               const std::vector<unsigned char>& fixed);
+
+    void setThreadPool(ThreadPool* thePool);
+
+    // Solves matrix x = b for x, x, y and z separately, starting from the x given, until every
+    // residual is at most tolerance times the largest right hand side, or for maxIterations.
+    // Returns the iterations taken.
+    GLuint solve(const glm::vec3* b, glm::vec3* x, GLfloat tolerance, GLuint maxIterations, MultigridUse use);
+
+    GLuint getLevelCount();
+    GLuint getUnknownCount(GLuint level);
+
+private:
+    struct Level {
+        SparseMatrix matrix;
+        SparseMatrix prolongation; // from the next coarser level
+        SparseMatrix restriction;  // to the next coarser level
+        std::vector<GLfloat> inverseDiagonal; // of the sums of the magnitudes of the rows
+        std::vector<GridLayout> grids;
+        std::vector<glm::vec3> b, x, r; // right hand side, solution and residual of a V-cycle
+    };
+
+    std::vector<Level> levels;
+    std::vector<unsigned char> fixed;
+    std::vector<double> coarsestFactor; // lower triangle of the Cholesky factor, row by row
+    std::vector<glm::dvec3> coarsestWork;
+    std::vector<glm::vec3> residual, direction, preconditioned, product; // of conjugate gradients
+    std::vector<glm::dvec3> blockSums;
+    ThreadPool* pool;
+
+    void forEachBlock(GLuint count, BlockFunction work);
+    glm::dvec3 dot(const glm::vec3* a, const glm::vec3* b);
+
+    static SparseMatrix coarsen(const std::vector<GridLayout>& grids, std::vector<GridLayout>& coarseGrids);
+    void factorCoarsest();
+
+    void precondition(const glm::vec3* r, glm::vec3* z, MultigridUse use);
+    void vCycle(GLuint level, const glm::vec3* b, glm::vec3* x);
+    void smooth(GLuint level, const glm::vec3* b, glm::vec3* x, bool fromZero);
+    void solveCoarsest(const glm::vec3* b, glm::vec3* x);
+};
+
+#endif //TYGLADIG_MULTIGRID_H
@@ -0,0 +1,35 @@
+#ifndef TYGLADIG_NUMA_H
+#define TYGLADIG_NUMA_H
+
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// The NUMA nodes of the host and the CPUs of each. On a multi-socket host memory is attached to
+// one socket, and a thread reading memory of another node pays for the interconnect, so work
+// that streams through large arrays should run on the node holding them.
+//
+// Linux places a page on the node of the thread that first writes it. Pinning threads to the CPUs
+// of a node and letting each write the part of an array it will process puts that part on its node.
+class NumaTopology {
+public:
+    // Every list holds the CPUs of one node
+    NumaTopology(const std::vector<std::vector<int>>& theNodes);
+
+    // Reads the nodes from /sys/devices/system/node, a single node with every CPU where that is
+    // not available
+    static NumaTopology detect();
+
+    GLuint getNodeCount() const;
+    const std::vector<int>& getCpus(GLuint node) const;
+
+    // Restricts the calling thread to cpus, false if the system does not allow it
+    static bool pinThread(const std::vector<int>& cpus);
+
+private:
+    std::vector<std::vector<int>> nodes;
+};
+
+#endif //TYGLADIG_NUMA_H
@@ -0,0 +1,149 @@
+#ifndef TYGLADIG_PROFILER_H
+#define TYGLADIG_PROFILER_H
+
+// Hot path instrumentation: scoped timers for the phases of a frame and counters for the work
+// done. Everything is compiled out unless the build defines TYGLADIG_PROFILING
+// (cmake -DTYGLADIG_PROFILING=ON), so the macros below cost nothing in normal builds.
+//
+//   PROFILE_SCOPE(PHASE_FORCES);            times the rest of the enclosing block
+//   PROFILE_COUNT(COUNTER_SPRINGS, n);      adds n to a counter
+//   PROFILE_FRAME(frame);                   tags the following samples with a frame number
+//   PROFILE_THREAD_NAME("render");          names the calling thread in reports
+//   PROFILE_TRACE("trace.json");            writes the recorded samples as a Chrome trace
+//
+// Every thread records into its own ring buffer, which only that thread writes, so recording
+// takes no locks. The ring keeps the most recent samples, the per phase totals cover all of them.
+// The samples in the rings can be written as a Chrome trace (chrome://tracing or ui.perfetto.dev)
+// to see the timeline of every thread.
+
+enum ProfilePhase {
+    PHASE_FRAME,     // one iteration of the render loop
+    PHASE_SIMULATE,  // one call to World::step
+    PHASE_FORCES,
+    PHASE_WIND,      // aerodynamic forces of the triangles
+    PHASE_INTEGRATE,
+    PHASE_COLLIDE,
+    PHASE_PACK,
+    PHASE_UPLOAD,
+    PHASE_SWAP,
+    PHASE_GPU,       // GPU time of the upload and draw, measured with timer queries
+    PHASE_CACHE,     // encoding and writing a frame cache chunk
+    PHASE_EXPORT,    // writing a mesh file
+    PHASE_COUNT
+};
+
+enum ProfileCounter {
+    COUNTER_SPRINGS,    // spring evaluations
+    COUNTER_SUBSTEPS,
+    COUNTER_ITERATIONS, // solver iterations
+    COUNTER_COUNT
+};
+
+#ifdef TYGLADIG_PROFILING
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+struct ProfileSample {
+    uint32_t phase;
+    uint32_t frame;
+    uint64_t start; // nanoseconds since the profiler started
+    uint64_t end;
+};
+
+struct ProfileTotals {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+
+// The samples and counters of one thread
+class ProfileBuffer {
+public:
+    static const uint32_t CAPACITY = 1 << 16;
+
+    ProfileBuffer(uint32_t theThreadIndex);
+
+    void record(uint32_t phase, uint64_t start, uint64_t end);
+    void record(uint32_t phase, uint64_t start, uint64_t end, uint32_t frame);
+    void count(uint32_t counter, uint64_t amount);
+
+    // Copies the samples still in the ring, oldest first. Safe to call from any thread, samples
+    // recorded during the copy may be missed.
+    void getSamples(std::vector<ProfileSample>& out);
+
+    uint32_t threadIndex;
+    std::string threadName;
+    ProfileTotals totals[PHASE_COUNT];
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+private:
+    ProfileSample samples[CAPACITY];
+    std::atomic<uint64_t> head; // number of samples ever recorded
+};
+
+class Profiler {
+public:
+    // The calling thread's buffer, created the first time a thread records something
+    static ProfileBuffer& threadBuffer();
+
+    // A buffer that is not tied to a thread, for timings measured elsewhere such as on the GPU.
+    // Only one thread may record into it.
+    static ProfileBuffer& createBuffer(std::string name);
+
+    // Buffers of every thread that has recorded something
+    static std::vector<ProfileBuffer*> getBuffers();
+
+    static uint64_t now();
+
+    static void setFrame(uint32_t frame);
+    static uint32_t getFrame();
+
+    // Prints per phase timings and counter totals over all threads
+    static void report(std::ostream& out);
+
+    // Writes the samples of every buffer in the Chrome trace event format, one track per buffer
+    static bool writeTrace(std::string fileName);
+
+    static const char* phaseName(uint32_t phase);
+    static const char* counterName(uint32_t counter);
+};
+
+class ProfileScope {
+public:
+    ProfileScope(ProfilePhase thePhase) : phase(thePhase), start(Profiler::now()) {}
+    ~ProfileScope() {
+        Profiler::threadBuffer().record(phase, start, Profiler::now());
+    }
+
+private:
+    ProfilePhase phase;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(phase)
+#define PROFILE_COUNT(counter, amount) Profiler::threadBuffer().count(counter, amount)
+#define PROFILE_FRAME(frame) Profiler::setFrame(frame)
+#define PROFILE_THREAD_NAME(name) (Profiler::threadBuffer().threadName = (name))
+#define PROFILE_REPORT(out) Profiler::report(out)
+#define PROFILE_TRACE(fileName) Profiler::writeTrace(fileName)
+
+#else
+
+#define PROFILE_SCOPE(phase) do {} while (0)
+#define PROFILE_COUNT(counter, amount) do {} while (0)
+// The frame is named but not evaluated, so a counter kept only for the profiler is not unused
+#define PROFILE_FRAME(frame) do { (void)sizeof(frame); } while (0)
+#define PROFILE_THREAD_NAME(name) do {} while (0)
+#define PROFILE_REPORT(out) do {} while (0)
+#define PROFILE_TRACE(fileName) do {} while (0)
+
+#endif //TYGLADIG_PROFILING
+
+#endif //TYGLADIG_PROFILER_H
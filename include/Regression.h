@@ -0,0 +1,69 @@
+#ifndef TYGLADIG_REGRESSION_H
+#define TYGLADIG_REGRESSION_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "Scene.h"
+
+// Regression checks of the solver against stored golden states, run without a window. A
+// regression file is an INI file with one [case] section per reference scene:
+//
+//   [case]
+//   scene = default.ini                 scene to simulate, relative to the regression file
+//   frames = 600                        frames to simulate
+//   golden = golden/default.golden      positions after the last frame, relative to the regression file
+//   tolerance = 0.0001                  largest allowed distance of a coordinate from the golden state
+//   maxStrain = 0.5                     largest allowed relative stretch of a structural spring at the end
+//
+// Besides matching the golden state, the energy of every case has to stay within the blow-up limit
+// of the sweeps on every frame, the final positions have to be finite and a run on a thread pool
+// has to end in exactly the same state as the run on the calling thread. Builds that count
+// allocations also check that no frame after the first allocates memory.
+
+struct RegressionCase {
+    std::string name;
+    Scene scene;
+    GLuint frames;
+    std::string golden;
+    GLfloat tolerance;
+    GLfloat maxStrain;
+};
+
+struct RegressionResult {
+    bool passed;
+    GLfloat deviation;  // largest distance of a coordinate from the golden state
+    GLfloat energyGain; // largest energy increase over the start, relative to the blow-up limit
+    GLfloat strain;
+    bool deterministic;
+    uint64_t allocations; // made by the frames after the first, in builds that count them
+    std::string failure; // what failed first, empty if the case passed
+};
+
+class Regression {
+public:
+    // Reads a regression file, returns false if it could not be read
+    bool load(std::string fileName);
+
+    // Runs every case and compares it with its golden state, or with writeGolden replaces the
+    // golden states with the new results. Returns true if every case passed.
+    bool run(bool writeGolden, GLuint threadCount);
+
+    void report(std::ostream& out);
+
+private:
+    std::vector<RegressionCase> cases;
+    std::vector<RegressionResult> results;
+
+    static RegressionResult check(const RegressionCase& regressionCase, bool writeGolden, GLuint threadCount);
+    static bool readGolden(std::string fileName, std::vector<GLfloat>& positions);
+    static bool writeGoldenFile(std::string fileName, const std::vector<GLfloat>& positions, GLuint frames, uint64_t hash);
+};
+
+#endif //TYGLADIG_REGRESSION_H
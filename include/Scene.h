@@ -0,0 +1,187 @@
+#ifndef TYGLADIG_SCENE_H
+#define TYGLADIG_SCENE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+// Describes everything needed to set up a simulation. Scenes are loaded from INI files:
+//
+//   [material]                 k, b, mass of the particles, tearStrain and bendStiffness, shared by all cloths
+//   [cloth]                    width, height (particles), restLength, corner (position of particle 0,0),
+//                              optionally k, b, mass, tearStrain and bendStiffness of this cloth only, pin lines, and
+//                              copies (along x and z) and spacing (x z) to lay out a grid of identical cloths,
+//                              or mesh, an OBJ or PLY file relative to the scene file, instead of the grid,
+//                              moved by corner
+//   [pins]                     one "pin = row column" line per stationary particle of the last cloth, or
+//                              "pin = vertex" for a mesh, which hangs from nothing without pins
+//   [solver]                   h, substeps (steps per frame) and gravity, method = explicit, implicit or
+//                              projective, for implicit multigrid = preconditioner, solver or none,
+//                              tolerance and maxIterations of the implicit and projective solves,
+//                              tethers = on or off and tetherSlack, adaptive = on or off with
+//                              errorTolerance, minH, maxH and cfl, precision = float, double or mixed,
+//                              restLengths = exact or quantised (16 bits), particleOrder = grid or morton,
+//                              bending = springs or quadratic
+//   [interaction]              push, the force applied to the middle particle while the mouse is pressed
+//   [collider]                 type = sphere (center, radius) or plane (normal, offset), one section each
+//   [wind]                     type = none, uniform, turbulent or gusts, velocity, density, drag and lift,
+//                              turbulence, turbulenceScale and turbulenceFrequency (turbulent),
+//                              gustStrength and gustPeriod (gusts)
+//
+// Vectors are written as three numbers separated by spaces. Anything not given in the file keeps
+// the value of the default scene, a 9x9 cloth hanging from its two top corners. The first [cloth]
+// section of a file changes the first cloth, every further one adds a cloth.
+
+struct Material {
+    GLfloat k;    // spring constant
+    GLfloat b;    // damping constant
+    GLfloat mass; // mass of the particles
+    GLfloat tearStrain; // springs stretched more than this fraction of their rest length tear, 0 never tears
+    GLfloat bendStiffness; // of the quadratic bending model
+};
+
+struct Pin {
+    GLuint row;
+    GLuint column;
+};
+
+class ClothMesh;
+
+// A rectangular cloth or a cloth read from a mesh file, or a grid of copies of it. A mesh is
+// one row of as many particles as it has vertices, so its pins are in row 0.
+struct ClothSettings {
+    GLuint width, height;       // particles
+    GLfloat restLength;
+    glm::vec3 corner;           // position of particle 0,0 of the first copy, or where a mesh's origin goes
+    std::string meshFile;
+    std::shared_ptr<const ClothMesh> mesh; // read from meshFile when the scene is loaded, null for a grid
+    Material material;          // negative values are taken from the scene's material
+    std::vector<Pin> pins;
+    GLuint copiesX, copiesZ;
+    GLfloat spacingX, spacingZ; // distance between the corners of neighbouring copies
+};
+
+enum ColliderType {
+    COLLIDER_SPHERE,
+    COLLIDER_PLANE
+};
+
+struct Collider {
+    ColliderType type;
+    glm::vec3 center; // sphere
+    GLfloat radius;
+    glm::vec3 normal; // plane, the points x with dot(normal, x) >= offset are outside
+    GLfloat offset;
+};
+
+enum WindType {
+    WIND_NONE,
+    WIND_UNIFORM,   // the same velocity everywhere
+    WIND_TURBULENT, // velocity plus a noise field that moves over time
+    WIND_GUSTS      // velocity that swells to (1 + gustStrength) times itself once every gustPeriod
+};
+
+// Air moving past the cloth, which pushes on every triangle with drag along the relative wind and
+// lift across it, in proportion to the area the triangle shows the wind
+struct Wind {
+    WindType type;
+    glm::vec3 velocity;
+    GLfloat density;             // of the air
+    GLfloat drag;                // drag coefficient
+    GLfloat lift;                // lift coefficient
+    GLfloat turbulence;          // largest speed the noise adds
+    GLfloat turbulenceScale;     // spatial frequency of the noise
+    GLfloat turbulenceFrequency; // how fast the noise changes over time
+    GLfloat gustStrength;
+    GLfloat gustPeriod;          // seconds of simulated time between gusts
+};
+
+enum SolverMethod {
+    SOLVER_EXPLICIT,  // RK4 steps of the velocities and positions
+    SOLVER_IMPLICIT,  // backward Euler steps solving a linear system for the change of the velocities
+    SOLVER_PROJECTIVE // projective dynamics, local projections of the springs and a prefactored global solve
+};
+
+// The floating point type the world keeps its particles in and forms its sums in
+enum Precision {
+    PRECISION_FLOAT,  // float storage and sums, half the memory traffic of double
+    PRECISION_DOUBLE, // double storage and sums, for long runs float would drift on
+    PRECISION_MIXED   // float storage with the force and energy sums formed in double
+};
+
+// The order the world keeps its particles in, the numbers the world's queries give them stay the same
+enum ParticleOrder {
+    ORDER_GRID,  // row by row in every cloth, the particles split off by tearing at the end
+    ORDER_MORTON // along a Morton curve through the positions, sorted again as tearing adds particles
+};
+
+// How the cloths resist bending
+enum BendingModel {
+    BENDING_SPRINGS,  // springs between every particle and the next but one along the rows and columns
+    BENDING_QUADRATIC // an energy quadratic in the positions over every pair of triangles sharing an edge
+};
+
+// How the implicit solver uses its multigrid hierarchy
+enum MultigridUse {
+    MULTIGRID_PRECONDITIONER, // V-cycles precondition conjugate gradients
+    MULTIGRID_SOLVER,         // V-cycles alone
+    MULTIGRID_NONE            // conjugate gradients with a Jacobi preconditioner
+};
+
+struct SolverSettings {
+    GLfloat h;         // length of step for RK4 calculations
+    GLuint substeps;   // steps per rendered frame
+    glm::vec3 gravity;
+    SolverMethod method;
+    MultigridUse multigrid;
+    GLfloat tolerance;    // of the implicit solve relative to the right hand side, of the projective
+                          // solve relative to the largest move of a particle in the step
+    GLuint maxIterations; // of the implicit and projective solves
+    bool tethers;         // hold every particle within its path along the springs from the nearest pin
+    GLfloat tetherSlack;  // fraction of that path a tether may stretch
+    bool adaptive;          // explicit steps of varying size, h * substeps is then only the frame time
+    GLfloat errorTolerance; // error of an adaptive step relative to the shortest rest length
+    GLfloat minH, maxH;     // of an adaptive step, a maxH of 0 allows a whole frame
+    GLfloat cfl;            // fraction of the shortest rest length a particle may move in an adaptive step
+    Precision precision;
+    bool quantisedRestLengths; // 16 bit rest lengths, which halves the memory of the springs
+    ParticleOrder particleOrder;
+    BendingModel bending;
+};
+
+class Scene {
+public:
+    std::string name;
+
+    Material material;
+    std::vector<ClothSettings> cloths;
+    std::vector<Collider> colliders;
+    Wind wind;
+    SolverSettings solver;
+    glm::vec3 push;
+
+    // Creates the default scene
+    Scene();
+
+    // Reads a scene file on top of the current values, returns false if it could not be read
+    bool load(std::string fileName);
+
+    // The material of a cloth, its own values over the scene's
+    Material getMaterial(GLuint cloth) const;
+
+    // True if any cloth has a tear strain
+    bool canTear() const;
+
+private:
+    static ClothSettings defaultCloth();
+    bool setValue(std::string section, std::string key, std::string value, ClothSettings& cloth);
+};
+
+#endif //TYGLADIG_SCENE_H
@@ -0,0 +1,53 @@
+#ifndef TYGLADIG_SPARSECHOLESKY_H
+#define TYGLADIG_SPARSECHOLESKY_H
+
+#include <vector>
+#include <cstddef>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+#include "SparseMatrix.h"
+
+// Cholesky factorisation L L^T of a sparse symmetric positive definite matrix, for solving many
+// systems with the same matrix.
+//
+// The unknowns are first renumbered by reverse Cuthill-McKee, which numbers the neighbours of
+// every unknown close to it, one connected part of the matrix after the other. Every row of the
+// factor then only fills in from its first non-zero column in the renumbered matrix to the
+// diagonal, so the factor is stored as that envelope: for a grid about as many values per row as
+// the grid is wide, and nothing between unconnected cloths.
+//
+// The factor is computed in double precision. Solving allocates nothing and runs on the calling
+// thread, forward and back substitution are sequential by nature.
+class SparseCholesky {
+public:
+    SparseCholesky();
+
+    // Factors matrix, false if it is not positive definite
+    bool factor(const SparseMatrix& matrix);
+
+    // Solves matrix x = b for x, x, y and z at once. b and x may be the same.
+    void solve(const glm::vec3* b, glm::vec3* x);
+
+    GLuint getUnknownCount();
+
+    // Values stored in the envelope of the factor
+    size_t getFactorSize();
+
+private:
+    GLuint count;
+    std::vector<GLuint> order;      // original unknown of every renumbered one
+    std::vector<GLuint> firstColumn; // of every renumbered row of the factor
+    std::vector<size_t> rowStart;    // of the values of every row, firstColumn to the diagonal
+    std::vector<double> values;
+    std::vector<glm::dvec3> work;
+
+    static void reverseCuthillMcKee(const SparseMatrix& matrix, std::vector<GLuint>& order);
+};
+
+#endif //TYGLADIG_SPARSECHOLESKY_H
@@ -0,0 +1,97 @@
+#ifndef TYGLADIG_SPARSEMATRIX_H
+#define TYGLADIG_SPARSEMATRIX_H
+
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+#include "UninitialisedVector.h"
+
+// One value of a matrix being assembled
+struct MatrixEntry {
+    GLuint row, column;
+    GLfloat value;
+};
+
+// A sparse matrix in compressed sparse row form: the columns and values of row r are elements
+// [rowStart[r], rowStart[r + 1]) of columns and values, in ascending column order.
+//
+// The solvers apply one matrix to the x, y and z coordinates at once, so the products take
+// vectors of glm::vec3.
+struct SparseMatrix {
+    GLuint rowCount, columnCount;
+    std::vector<GLuint> rowStart;
+    std::vector<GLuint> columns;
+    std::vector<GLfloat> values;
+
+    SparseMatrix();
+
+    // Builds a matrix from entries in any order, repeated entries of an element are added up
+    static SparseMatrix fromEntries(GLuint rowCount, GLuint columnCount, std::vector<MatrixEntry> entries);
+
+    // The same, but repeated entries of an element are added up in double in the order they are
+    // given, whatever other entries there are, and in time linear in the entries
+    static SparseMatrix fromOrderedEntries(GLuint rowCount, GLuint columnCount, const std::vector<MatrixEntry>& entries);
+
+    SparseMatrix transpose() const;
+
+    // this * other, summed in ascending column order of this
+    SparseMatrix multiply(const SparseMatrix& other) const;
+
+    // Value of element row, column, 0 if it is not stored
+    GLfloat get(GLuint row, GLuint column) const;
+
+    // y = this * x for rows [begin, end)
+    void multiply(const glm::vec3* x, glm::vec3* y, GLuint begin, GLuint end) const;
+
+    GLuint getNonZeroCount() const;
+};
+
+// A symmetric matrix whose rows sum to zero, such as a Hessian that moving everything along
+// does not change, in sliced ELLPACK form for products the compiler can vectorise. The rows are
+// taken in slices of SLICE_ROWS and entry k of every row of a slice is stored next to entry k of
+// the other rows, rows shorter than the longest of their slice are padded with zeros. The
+// diagonal follows from the other entries of its row and is not stored, the products sum
+// value * (x[column] - x[row]) instead, which stays exact however far the vector is from the
+// origin.
+//
+// The products take one array per coordinate and go through the eight rows of a slice in one
+// loop, with the sums of every row formed in the order of its entries, so they are the same on
+// any number of threads.
+struct SlicedMatrix {
+    static const GLuint SLICE_ROWS = 8;
+
+    GLuint rowCount;
+    std::vector<GLuint> sliceStart; // first entry of every slice, and the end of the last
+    UninitialisedVector<GLuint> columns;
+    UninitialisedVector<GLfloat> values;
+    GLuint entryCount; // without the padding
+
+    SlicedMatrix();
+
+    // Takes the entries off the diagonal of matrix, row and column i of which become
+    // renumbering[i], or stay i if renumbering is empty. The entries of every row keep their order.
+    SlicedMatrix(const SparseMatrix& matrix, const std::vector<GLuint>& renumbering);
+
+    // Where the entries of the slices from the one holding row on start in columns and values,
+    // for row a multiple of SLICE_ROWS or rowCount, so that rows [begin, end) own the entries
+    // [firstEntry(begin), firstEntry(end))
+    GLuint firstEntry(GLuint row) const;
+
+    // product = this * (x, y, z) for rows [begin, end), begin a multiple of SLICE_ROWS, summed in Sum
+    template <typename Real, typename Sum>
+    void multiply(const Real* x, const Real* y, const Real* z, Real* productX, Real* productY, Real* productZ,
+                  GLuint begin, GLuint end) const;
+
+    // The part of rows [begin, end) in the quadratic form of (x, y, z) with this matrix, which is
+    // -1/2 times the sum of value * |p[column] - p[row]|^2 over their entries
+    template <typename Real, typename Sum>
+    Sum quadraticForm(const Real* x, const Real* y, const Real* z, GLuint begin, GLuint end) const;
+};
+
+#endif //TYGLADIG_SPARSEMATRIX_H
@@ -0,0 +1,59 @@
+#ifndef TYGLADIG_SWEEP_H
+#define TYGLADIG_SWEEP_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "Scene.h"
+
+// A parameter sweep runs one scene for every combination of spring constants, damping constants
+// and step lengths, without a window and with the configurations spread over a thread pool.
+// Sweep files are INI files with a single [sweep] section:
+//
+//   scene = default.ini    scene to start from, relative to the sweep file (the default scene if left out)
+//   time = 10              simulated time of every run
+//   k = 0.5 1 2 4          values to try, the scene's value if left out
+//   b = 0.05 0.1
+//   h = 0.007 0.014
+//   output = sweep.csv     optional CSV file with the results
+//
+// A run is unstable when the energy of the cloth becomes invalid or grows by more than the cloth
+// could gain by falling its own size, which only happens when the integration blows up.
+
+struct SweepResult {
+    GLfloat k, b, h;
+    GLuint steps;        // steps simulated, fewer than planned if the run blew up
+    bool stable;
+    GLfloat energyGain;  // largest energy increase over the start, relative to the blow-up limit
+    double milliseconds;
+};
+
+class Sweep {
+public:
+    Sweep();
+
+    // Reads a sweep file, returns false if it could not be read
+    bool load(std::string fileName);
+
+    // Runs every configuration, one task per configuration
+    void run(GLuint threadCount);
+
+    void report(std::ostream& out);
+    bool writeCsv();
+
+private:
+    Scene scene;
+    GLfloat time;
+    std::vector<GLfloat> kValues, bValues, hValues;
+    std::string output;
+    std::vector<SweepResult> results;
+
+    static void simulate(Scene scene, GLfloat time, SweepResult& result);
+};
+
+#endif //TYGLADIG_SWEEP_H
@@ -0,0 +1,124 @@
+#ifndef TYGLADIG_THREADPOOL_H
+#define TYGLADIG_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "Numa.h"
+
+// Refers to a callable taking a block [begin, end) without copying it, so handing work to the pool
+// allocates nothing. The callable has to outlive the reference.
+class BlockFunction {
+public:
+    template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, BlockFunction>::value>::type>
+    BlockFunction(const F& function) : callable(&function), invoke(&call<F>) {}
+
+    void operator()(GLuint begin, GLuint end) const {
+        invoke(callable, begin, end);
+    }
+
+private:
+    template <typename F>
+    static void call(const void* function, GLuint begin, GLuint end) {
+        (*static_cast<const F*>(function))(begin, end);
+    }
+
+    const void* callable;
+    void (*invoke)(const void*, GLuint, GLuint);
+};
+
+// A work-stealing thread pool. Every worker has its own task queue: a worker takes the newest
+// task of its own queue and, when that is empty, steals the oldest task of another worker.
+// Tasks submitted from outside the pool are spread over the queues round robin.
+//
+// parallelFor does not go through the queues: the workers and the calling thread claim the blocks
+// of the loop one by one, which allocates nothing.
+//
+// A pool can be laid over the NUMA nodes of the host. The workers are then split into one
+// contiguous group per node and pinned to its CPUs, and the blocks of a loop into as many
+// contiguous partitions, so block b of a loop of a given size is always run on the same node.
+// Workers claim the blocks of their own partition first and only then help with the others.
+class ThreadPool {
+public:
+    static const GLuint MAX_PARTITIONS = 64;
+
+    // Zero threads means one per hardware thread
+    ThreadPool(GLuint threadCount = 0);
+
+    // Pins the workers to the nodes of topology, at most one node per worker
+    ThreadPool(GLuint threadCount, const NumaTopology& topology);
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    // Runs work(begin, end) over [0, count) in blocks of blockSize and waits for all of them.
+    // The blocks only depend on count and blockSize, never on the number of threads, so work that
+    // writes per block results gives the same results on any pool. Must not be called from inside a
+    // task, and only by one thread at a time.
+    //
+    // Without stealing every block runs on a worker of its own partition and the calling thread
+    // only waits, for work that has to happen on a node such as the first touch of memory.
+    void parallelFor(GLuint count, GLuint blockSize, BlockFunction work, bool stealing = true);
+
+    // Waits until every submitted task has finished, the calling thread helps running them.
+    // Must not be called from inside a task.
+    void wait();
+
+    GLuint getThreadCount();
+
+    // Number of nodes the workers are spread over, 1 when they are not pinned
+    GLuint getPartitionCount();
+
+private:
+    struct TaskQueue {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+    std::vector<GLuint> workerPartition;
+    std::vector<std::vector<int>> workerCpus; // empty when the workers are not pinned
+    GLuint partitionCount;
+    std::atomic<GLuint> nextQueue;
+    std::atomic<GLuint> queued;     // tasks waiting in a queue
+    std::atomic<GLuint> unfinished; // tasks queued or running
+    bool stopping;
+    GLuint started; // workers that have entered their loop
+
+    std::mutex sleepMutex;
+    std::condition_variable taskAdded;
+    std::condition_variable allDone;
+
+    // The loop of the running parallelFor, guarded by loopMutex
+    std::mutex loopMutex;
+    std::condition_variable loopFinished;
+    const BlockFunction* loopWork;
+    GLuint loopCount, loopBlockSize;
+    std::atomic<bool> loopStealing;
+    std::vector<GLuint> partitionNext, partitionEnd; // next and end block of every partition
+    GLuint loopRunning; // claimed blocks that have not finished
+    GLuint loopLeft;    // blocks left to claim
+    std::atomic<uint64_t> loopOpen; // bit p is set while partition p has blocks left to claim
+
+    void start(GLuint threadCount);
+    void workerLoop(GLuint self);
+    bool runTask(GLuint self);
+    bool runLoopBlock(GLuint partition);
+    bool canClaim(GLuint partition);
+};
+
+#endif //TYGLADIG_THREADPOOL_H
@@ -0,0 +1,43 @@
+#ifndef TYGLADIG_UNINITIALISEDVECTOR_H
+#define TYGLADIG_UNINITIALISEDVECTOR_H
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// An allocator that leaves new elements of trivially copyable types as they are where
+// std::allocator value-initialises them, so resize does not zero them. That includes types like
+// glm's vectors, whose default constructor zeroes them, since their bytes are all there is to
+// them. Memory that has just come from the system then stays untouched until the elements are
+// first written, which lets the workers that process an array decide which NUMA node its pages
+// are placed on.
+template <typename T>
+struct UninitialisedAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        typedef UninitialisedAllocator<U> other;
+    };
+
+    UninitialisedAllocator() {}
+
+    template <typename U>
+    UninitialisedAllocator(const UninitialisedAllocator<U>&) {}
+
+    template <typename U>
+    void construct(U* element) {
+        if (!std::is_trivially_copyable<U>::value)
+            ::new (static_cast<void*>(element)) U;
+    }
+
+    template <typename U, typename... Arguments>
+    void construct(U* element, Arguments&&... arguments) {
+        ::new (static_cast<void*>(element)) U(std::forward<Arguments>(arguments)...);
+    }
+};
+
+template <typename T>
+using UninitialisedVector = std::vector<T, UninitialisedAllocator<T>>;
+
+#endif //TYGLADIG_UNINITIALISEDVECTOR_H
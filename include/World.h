@@ -0,0 +1,179 @@
+#ifndef TYGLADIG_WORLD_H
+#define TYGLADIG_WORLD_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// GLM
+#include <glm.hpp>
+
+#include "Scene.h"
+#include "ThreadPool.h"
+
+enum SpringType {
+    SPRING_STRUCTURAL,
+    SPRING_SHEAR,
+    SPRING_BEND
+};
+
+// A cloth of the world. Its grid of particles, its springs and its triangles are consecutive
+// ranges of the world's arrays, the particles row by row.
+struct Cloth {
+    GLuint width, height;
+    GLuint firstParticle;
+    GLuint firstSpring, springCount;
+    GLuint firstTriangle, triangleCount;
+    GLuint material;
+};
+
+// All cloths of a scene, every copy of every cloth as a grid of particles connected by
+// structural, shear and bend springs and dampers. The scene's wind acts on the triangles of the
+// surfaces.
+//
+// The cloths share one array per particle attribute, one list of springs and one list of
+// triangles, so every step runs each kernel once over the whole world whatever the number of
+// cloths. A spring finds its constants through its material, a particle has its own mass. The rest
+// lengths can be quantised to 16 bits, which halves the spring records.
+//
+// With a tear strain in the material, springs stretched further than that break. A particle
+// whose triangles are no longer held together by springs is then split into one particle per
+// group of connected triangles, so the particle count grows as the cloth tears while the
+// triangle count stays the same.
+//
+// The particles are processed in fixed blocks of BLOCK_SIZE particles, with or without a thread
+// pool. Every particle gathers its own force and sums can only be formed per block and then in
+// block order, so a step gives bitwise identical results for any number of threads.
+//
+// With a pool over several NUMA nodes a block is always run on the same node, which holds that
+// block's part of the arrays, so a node only reads another node's memory for the springs and
+// triangles whose particles lie in blocks on both sides of a partition border. The grids are
+// numbered row by row, which keeps those borders short.
+//
+// The particles can instead be kept in Morton order of their positions, sorted again whenever
+// tearing has added a sixteenth more, so that neighbours in space stay neighbours in the arrays
+// however the cloth came apart. Every particle keeps the number it has in grid order in all the
+// queries below, and nothing a particle sums changes order, so the results stay the same.
+//
+// Tethers keep every particle within the length of the shortest path along the springs to its
+// nearest pin, so the cloth cannot hang further from its pins than its rest shape allows however
+// soft the springs are. The paths are searched when the world is set up and again whenever pins
+// change or springs tear, and each substep moves the particles that are too far back onto the
+// sphere their tether spans around the pin.
+//
+// Adaptive explicit steps follow the motion instead of keeping h. Each step is checked against
+// the accelerations at its end, taken back and tried shorter when its error estimate is too large,
+// and the next one sized from that error and from the fastest particle.
+//
+// The implicit solver takes backward Euler steps, (M - h D - h^2 K) dv = h f + h^2 K v, with the
+// Jacobians K and D of the spring and damper forces replaced by -k L and -b L, L the graph
+// Laplacian of the springs. That drops the directions of the springs but leaves a matrix that
+// stays the same from step to step, so it is set up once and solved with multigrid.
+//
+// The projective solver takes the same steps as positions, alternating between projecting every
+// spring onto its rest length and one global solve that balances those projections against the
+// momentum of the particles. The matrix of the global solve is the one of the implicit solver and
+// never changes, so it is factored once and every iteration costs a pass over the springs and
+// a forward and back substitution.
+//
+// The simulation is written once for a storage type Real and a type Sum the forces and energies
+// are summed in, see BasicWorld. The scene's precision picks float, double or float storage with
+// double sums, and create returns the world of that choice behind this interface.
+//
+// Stepping allocates no memory. Everything that lives longer than a step is sized when the world
+// is set up, including room for the particles tearing can add, and the scratch of a step comes
+// from an arena that is reset at its start.
+class World {
+public:
+    static const GLuint BLOCK_SIZE = 256;
+
+    static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+    // A world of the whole scene, in the precision of its solver settings
+    static std::unique_ptr<World> create(const Scene& scene);
+
+    // Only rows [firstRow, firstRow + rowCount) of the scene's single cloth, with the particles
+    // and springs those rows have in the whole cloth. The particles of rows inside the band get
+    // exactly the forces they get in the whole cloth as long as the two rows next to them hold
+    // the same states, so bands can be simulated apart and put together.
+    static std::unique_ptr<World> create(const Scene& scene, GLuint firstRow, GLuint rowCount);
+
+    virtual ~World();
+
+    // Spreads the blocks of every step over a pool, null to simulate on the calling thread.
+    // Must not be set when the world is stepped from inside a task of the same pool. When the
+    // pool is spread over several NUMA nodes the particle, spring and triangle arrays are moved
+    // so every block's part of them lives on the node that runs it.
+    virtual void setThreadPool(ThreadPool* thePool) = 0;
+
+    // Advances the simulation by one frame, push applies the scene's push force to the middle
+    // particle of every cloth
+    virtual void step(bool push) = 0;
+
+    // One substep of step, without resetting the scratch of the step
+    virtual void substep(bool push) = 0;
+
+    virtual GLuint getClothCount() = 0;
+    virtual const Cloth& getCloth(GLuint cloth) = 0;
+
+    virtual GLuint getParticleCount() = 0;
+
+    // Triangle list of all cloth surfaces, cloth after cloth
+    virtual const std::vector<GLuint>& getIndices() = 0;
+
+    // Moves the triangles whose indices changed since the last call into triangles, in ascending
+    // order, so an index buffer can be updated in place
+    virtual void takeChangedTriangles(std::vector<GLuint>& triangles) = 0;
+
+    // Makes a particle stationary or lets it go. The tethers are searched again and the implicit
+    // or projective system is set up again, which allocates memory.
+    virtual void setPinned(GLuint particle, bool isPinned) = 0;
+    virtual bool isPinned(GLuint particle) = 0;
+
+    // Springs that have not been torn
+    virtual GLuint getSpringCount() = 0;
+
+    // Writes x, y, z of every particle: the grids cloth after cloth, then the particles split off by tearing
+    virtual void getPositions(GLfloat* positions) = 0;
+
+    // Total mechanical energy: kinetic, elastic energy of the springs and potential energy of gravity
+    virtual GLfloat getEnergy() = 0;
+
+    // Energy the cloths could at most gain by falling their own size. A larger increase of the
+    // energy than this only happens when the integration blows up.
+    virtual GLfloat getEnergyScale() = 0;
+
+    // Largest relative stretch or compression of a structural spring that is not torn
+    virtual GLfloat getMaxStrain() = 0;
+
+    // Simulated time of one call to step
+    virtual GLfloat getFrameTime() = 0;
+
+    // Solver iterations of the last step over all substeps, one per substep for the explicit solver
+    virtual GLuint getIterations() = 0;
+
+    // FNV-1a hash of the bits of every position and velocity as getStates writes them, equal
+    // hashes mean identical states
+    uint64_t getStateHash();
+
+    // Continues hash over the bits of count states as written by getStates
+    static uint64_t hashStates(const GLfloat* states, GLuint count, uint64_t hash);
+
+    // Copies the position and velocity of particles [first, first + count), x, y, z of both per
+    // particle, rounded to float in a double world
+    virtual void getStates(GLuint first, GLuint count, GLfloat* states) = 0;
+    virtual void setStates(GLuint first, GLuint count, const GLfloat* states) = 0;
+
+    // Largest error of a rest length relative to itself, 0 unless the rest lengths are quantised
+    virtual GLfloat getRestLengthError() = 0;
+
+    // Memory the springs take, the spring records and the exact rest lengths
+    virtual size_t getSpringBytes() = 0;
+};
+
+#endif //TYGLADIG_WORLD_H
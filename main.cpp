@@ -1,4 +1,11 @@
 #include <iostream>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <iomanip>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
 
 // GLEW
 #define GLEW_STATIC
@@ -20,6 +27,17 @@
 #include "ShaderProgram.hpp"
 #include "Camera.h"
 #include "Particle.h"
+#include "Scene.h"
+#include "World.h"
+#include "Sweep.h"
+#include "Regression.h"
+#include "ThreadPool.h"
+#include "Numa.h"
+#include "Decomposition.h"
+#include "Profiler.h"
+#include "GpuProfiler.h"
+#include "FrameCache.h"
+#include "MeshExporter.h"
 
 /*******************************************
  ****** FUNCTION/VARIABLE DECLARATIONS *****
@@ -40,25 +58,148 @@ bool firstMouse = true;
 // Stores key information if the key is pressed or not
 bool keys[1024];
 bool run = false;
+bool paused = false;
+bool releasePin = false;
+
+bool check_determinism(const Scene& scene, GLuint frames, GLuint maxThreads, bool pinToNodes);
+bool check_processes(const Scene& scene, GLuint frames, GLuint maxProcesses);
+bool check_quantisation(const Scene& scene, GLuint frames);
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void do_movement();
 
-glm::vec3 theSpringForce(Particle p1, Particle p2, float L0, float k);
-glm::vec3 theDampForce(Particle p1, Particle p2, float b);
-glm::vec3 RungeKuttaForVel(Particle p, float h);
-glm::vec3 RungeKuttaForPosDiff(Particle p, float h);
-
 
 /*******************************************
  **************    MAIN     ****************
  *******************************************/
 
 // The MAIN function, from here we start the application and run the rendering loop
-int main()
+// Usage: TYGlaDig [--scene <scene file>] [--record <cache directory>] [--cache-error <error bound>]
+//                 [--play <cache directory>] [--export <mesh directory>] [--export-format ply|obj]
+//                 [--sweep <sweep file>] [--threads <count>] [--numa] [--trace <trace file>]
+//                 [--check-determinism <frames>] [--check-processes <frames>] [--processes <count>]
+//                 [--check-quantisation <frames>] [--verify <regression file> [--write-golden]]
+int main(int argc, char* argv[])
 {
+    // The scene to simulate, the default scene unless a scene file is given
+    Scene scene;
+    std::string sceneFile;
+    // A parameter sweep runs without a window and exits
+    std::string sweepFile;
+    // Threads of the sweep or the simulation, zero for one per hardware thread
+    GLuint threadCount = 0;
+    // Pins the simulation threads to the NUMA nodes of the host and spreads the cloths over them
+    bool pinToNodes = false;
+    // Runs the scene with different numbers of threads and compares the results, without a window
+    GLuint determinismFrames = 0;
+    // Runs the scene split over 2 to processCount processes and compares the results, without a window
+    GLuint processFrames = 0;
+    GLuint processCount = 4;
+    // Runs the scene with exact and with quantised rest lengths and compares the results, without a window
+    GLuint quantisationFrames = 0;
+    // Regression checks against golden states, without a window
+    std::string regressionFile;
+    bool writeGolden = false;
+    // Frame cache options, recording stores every simulated frame and playing replays them without simulating
+    std::string recordDirectory, playDirectory;
+    GLfloat cacheErrorBound = 0.0001f;
+    // Mesh export options, every simulated frame is written as a mesh file
+    std::string exportDirectory;
+    MeshFormat exportFormat = MESH_PLY;
+    // Chrome trace of the profiled phases, written at exit
+    std::string traceFile;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            sceneFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweepFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = (GLuint)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--numa") == 0) {
+            pinToNodes = true;
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--cache-error") == 0 && i + 1 < argc) {
+            cacheErrorBound = (GLfloat)std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            playDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            exportDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--export-format") == 0 && i + 1 < argc
+                   && MeshExporter::parseFormat(argv[i + 1], exportFormat)) {
+            i++;
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--check-determinism") == 0 && i + 1 < argc) {
+            determinismFrames = (GLuint)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--check-processes") == 0 && i + 1 < argc) {
+            processFrames = (GLuint)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            processCount = (GLuint)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--check-quantisation") == 0 && i + 1 < argc) {
+            quantisationFrames = (GLuint)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            regressionFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--write-golden") == 0) {
+            writeGolden = true;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--scene <scene file>] [--record <cache directory>]"
+                      << " [--cache-error <error bound>] [--play <cache directory>] [--export <mesh directory>]"
+                      << " [--export-format ply|obj] [--sweep <sweep file>] [--threads <count>] [--numa]"
+                      << " [--trace <trace file>] [--check-determinism <frames>] [--check-processes <frames>]"
+                      << " [--processes <count>] [--check-quantisation <frames>]"
+                      << " [--verify <regression file> [--write-golden]]" << std::endl;
+            return 1;
+        }
+    }
+
+#ifndef TYGLADIG_PROFILING
+    if (!traceFile.empty()) {
+        std::cerr << "Tracing needs a build configured with -DTYGLADIG_PROFILING=ON" << std::endl;
+        return 1;
+    }
+#endif
+
+    if (!sweepFile.empty()) {
+        Sweep sweep;
+        if (!sweep.load(sweepFile))
+            return 1;
+        sweep.run(threadCount);
+        sweep.report(std::cout);
+        PROFILE_REPORT(std::cout);
+        if (!traceFile.empty())
+            PROFILE_TRACE(traceFile);
+        return sweep.writeCsv() ? 0 : 1;
+    }
+
+    if (!regressionFile.empty()) {
+        Regression regression;
+        if (!regression.load(regressionFile))
+            return 1;
+        bool passed = regression.run(writeGolden, threadCount);
+        regression.report(std::cout);
+        return passed ? 0 : 1;
+    }
+
+    if (!sceneFile.empty() && !scene.load(sceneFile)) {
+        return 1;
+    }
+
+    // The frame cache and the mesh export keep the particles and triangles of the first frame
+    if (scene.canTear() && (!recordDirectory.empty() || !exportDirectory.empty())) {
+        std::cout << "A cloth that can tear cannot be recorded or exported" << std::endl;
+        return 1;
+    }
+
+    if (determinismFrames > 0)
+        return check_determinism(scene, determinismFrames, threadCount, pinToNodes) ? 0 : 1;
+    if (processFrames > 0)
+        return check_processes(scene, processFrames, processCount) ? 0 : 1;
+    if (quantisationFrames > 0)
+        return check_quantisation(scene, quantisationFrames) ? 0 : 1;
+
     std::cout << "Starting GLFW context, OpenGL 3.3" << std::endl;
     // Init GLFW
     if(!glfwInit()) {
@@ -107,42 +248,50 @@ int main()
     glfwSetScrollCallback(window, scroll_callback);
 
     /************** Declare variables **************/
-    GLfloat k = 1.0f; // spring constant
-    GLfloat b = 0.1f; // damping constant
-    GLfloat L0 = 0.1f; // rest length of the structural springs
-    GLfloat L0cross = sqrtf((float)pow(L0,2)*2); // rest length of the shear springs
-    GLfloat m = 1.0f; // mass of the particles
-    GLfloat h = 0.007f; // length of step for RK4 calculations
-
-    // Create all the particles and put them in a grid
-    // Always use an odd number
-    const GLuint clothWidth = 9, clothHeight = 9;
-    Particle theParticles[clothHeight][clothWidth];
-
-    float heightCounter = 5.0f;
-    for(GLuint i = 0; i < clothHeight; i++ ){
-        float widthCounter = -5.0f;
-        for(GLuint j = 0; j < clothWidth; j++){
-            theParticles[i][j] = Particle(m, glm::vec3(widthCounter*L0,0.0f, heightCounter*L0));
-            if(i == 0 & j == 0 || i == 0 & j == (clothHeight - 1) ) {
-                theParticles[i][j].makeStationary();
-            }
-            widthCounter++;
+    // Create the cloths described by the scene
+    std::unique_ptr<World> world = World::create(scene);
+    std::unique_ptr<ThreadPool> simulationPool(pinToNodes ? new ThreadPool(threadCount, NumaTopology::detect())
+                                                          : new ThreadPool(threadCount));
+    world->setThreadPool(simulationPool.get());
+    if (pinToNodes)
+        std::cout << "Simulating on " << simulationPool->getThreadCount() << " threads pinned to "
+                  << simulationPool->getPartitionCount() << " NUMA nodes" << std::endl;
+    const GLuint particleCount = world->getParticleCount();
+    const std::vector<GLuint>& indices = world->getIndices();
+
+    /***************** Frame cache ******************/
+    std::unique_ptr<FrameCacheWriter> recorder;
+    std::unique_ptr<FrameCacheReader> player;
+    GLuint playFrame = 0;
+    std::vector<GLfloat> framePositions(3 * particleCount);
+    world->getPositions(framePositions.data());
+
+    if (!playDirectory.empty()) {
+        player.reset(new FrameCacheReader(playDirectory));
+        if (!player->isOpen() || player->getParticleCount() != particleCount) {
+            std::cout << "Frame cache " << playDirectory << " does not match the scene" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "Playing " << player->getFrameCount() << " frames, "
+                  << "P pauses and the arrow keys scrub" << std::endl;
+    } else if (!recordDirectory.empty()) {
+        recorder.reset(new FrameCacheWriter(recordDirectory, particleCount, cacheErrorBound));
+        if (!recorder->isOpen()) {
+            glfwTerminate();
+            return -1;
         }
-        heightCounter--;
     }
 
-    GLuint indices[(clothHeight-1)*(clothWidth-1)*6];
-    int counter = 0;
-
-    for(GLuint i = 0; i < clothHeight-1; i++){
-        for(GLuint j = 0; j < clothWidth-1; j++){
-            indices[counter++] = i * clothWidth + j;
-            indices[counter++] = i * clothWidth + 1 + j;
-            indices[counter++] = i * clothWidth + clothWidth + j;
-            indices[counter++] = i * clothWidth + 1 + j;
-            indices[counter++] = i * clothWidth + clothWidth + 1 + j;
-            indices[counter++] = i * clothWidth + clothWidth + j;
+    /***************** Mesh export ******************/
+    std::unique_ptr<MeshExporter> exporter;
+    GLuint exportFrame = 0;
+
+    if (!exportDirectory.empty() && !player) {
+        exporter.reset(new MeshExporter(exportDirectory, exportFormat, indices, particleCount));
+        if (!exporter->isOpen()) {
+            glfwTerminate();
+            return -1;
         }
     }
 
@@ -152,6 +301,22 @@ int main()
     glGenBuffers(1, &VBO); // Create Buffer IDs
     glGenBuffers(1, &EBO);
 
+    // The triangles are uploaded once, afterwards only the ones changed by tearing
+    std::vector<GLuint> changedTriangles;
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+    glBindVertexArray(0);
+
+    // Every cloth is one draw of a single multi-draw call, over its range of the index buffer
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawOffsets;
+    for (GLuint c = 0; c < world->getClothCount(); c++) {
+        const Cloth& cloth = world->getCloth(c);
+        drawCounts.push_back((GLsizei)(3 * cloth.triangleCount));
+        drawOffsets.push_back((const GLvoid*)(3 * (size_t)cloth.firstTriangle * sizeof(GLuint)));
+    }
+
     /***************** Shaders ********************/
     // Build and compile the shader program
     std::string vertexFilename = "../shaders/vertexShader.vert";
@@ -167,8 +332,19 @@ int main()
     /******************* RENDER LOOP ********************/
     /****************************************************/
 
+    GLuint frame = 0;
+    // Interleaved positions and colours of the vertex buffer, kept between frames
+    std::vector<GLfloat> line_vertices;
+    PROFILE_THREAD_NAME("main");
+    // Reset before the context is destroyed, it owns query objects
+    std::unique_ptr<GpuProfiler> gpuProfiler(new GpuProfiler());
+
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_FRAME(frame++);
+        PROFILE_SCOPE(PHASE_FRAME);
+        gpuProfiler->collect();
+
         // Calculate deltatime of current frame
         GLfloat currentFrame = (GLfloat)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -201,113 +377,80 @@ int main()
         int state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
 
         /**************** RENDER STUFF ****************/
-        if(run) {
-            glm::vec3 gravity = glm::vec3(0.0f, -0.00098f * 2, 0.0f);
-
-            // Calculate the forces acting on the particles
-            for (GLuint i = 0; i < clothHeight; i++) {
-                for (GLuint j = 0; j < clothWidth; j++) {
-
-                    glm::vec3 theForce = glm::vec3(0.0f, 0.0f, 0.0f);
-
-                    // Bend springs and dampers
-                    if (j < clothWidth - 2) {
-                        theForce += theSpringForce(theParticles[i][j], theParticles[i][j + 2], (2.0f) * L0, k);
-                        theForce += (-1.0f) * theDampForce(theParticles[i][j], theParticles[i][j + 2], b);
-                    }
-                    if (i >= 2) {
-                        theForce += theSpringForce(theParticles[i][j], theParticles[i - 2][j], (2.0f) * L0, k);
-                        theForce += (-1.0f) * theDampForce(theParticles[i][j], theParticles[i - 2][j], b);
-                    }
-                    if (j >= 2) {
-                        theForce +=
-                                (-1.0f) * theSpringForce(theParticles[i][j - 2], theParticles[i][j], (2.0f) * L0, k);
-                        theForce += theDampForce(theParticles[i][j - 2], theParticles[i][j], b);
-                    }
-                    if (i < clothHeight - 2) {
-                        theForce +=
-                                (-1.0f) * theSpringForce(theParticles[i + 2][j], theParticles[i][j], (2.0f) * L0, k);
-                        theForce += theDampForce(theParticles[i + 2][j], theParticles[i][j], b);
-                    }
-
-                    // Shear springs and dampers
-                    if (i != 0 && j != clothWidth - 1) {
-                        theForce += theSpringForce(theParticles[i][j], theParticles[i - 1][j + 1], L0cross, k);
-                        theForce += (-1.0f) * theDampForce(theParticles[i][j], theParticles[i - 1][j + 1], b);
-                    }
-                    if (i != 0 && j != 0) {
-                        theForce += theSpringForce(theParticles[i][j], theParticles[i - 1][j - 1], L0cross, k);
-                        theForce += (-1.0f) * theDampForce(theParticles[i][j], theParticles[i - 1][j - 1], b);
-                    }
-                    if (i != clothHeight - 1 && j != 0) {
-                        theForce +=
-                                (-1.0f) * theSpringForce(theParticles[i + 1][j - 1], theParticles[i][j], L0cross, k);
-                        theForce += theDampForce(theParticles[i + 1][j - 1], theParticles[i][j], b);
-                    }
-                    if (i != clothHeight - 1 && j != clothWidth - 1) {
-                        theForce +=
-                                (-1.0f) * theSpringForce(theParticles[i + 1][j + 1], theParticles[i][j], L0cross, k);
-                        theForce += theDampForce(theParticles[i + 1][j + 1], theParticles[i][j], b);
-                    }
-
-
-                    // Structural springs and dampers
-                    if (j != clothWidth - 1) {
-                        theForce += theSpringForce(theParticles[i][j], theParticles[i][j + 1], L0, k);
-                        theForce += (-1.0f) * theDampForce(theParticles[i][j], theParticles[i][j + 1], b);
-                    }
-                    if (i != 0) {
-                        theForce += theSpringForce(theParticles[i][j], theParticles[i - 1][j], L0, k);
-                        theForce += (-1.0f) * theDampForce(theParticles[i][j], theParticles[i - 1][j], b);
-                    }
-                    if (j != 0) {
-                        theForce += (-1.0f) * theSpringForce(theParticles[i][j - 1], theParticles[i][j], L0, k);
-                        theForce += theDampForce(theParticles[i][j - 1], theParticles[i][j], b);
-                    }
-                    if (i != clothHeight - 1) {
-                        theForce += (-1.0f) * theSpringForce(theParticles[i + 1][j], theParticles[i][j], L0, k);
-                        theForce += theDampForce(theParticles[i + 1][j], theParticles[i][j], b);
-                    }
-
-                    if (state == GLFW_PRESS && (i == (clothHeight / 2) - 1) && (j == (clothWidth / 2) - 1)) {
-                        theForce += (glm::vec3(0.0f, 0.0f, 0.4f));
+        if(run && player) {
+            // Replay the cached frames instead of simulating, one cached frame per rendered frame
+            const GLfloat* cached = player->getFrame(playFrame);
+            if (cached != nullptr)
+                std::memcpy(framePositions.data(), cached, framePositions.size() * sizeof(GLfloat));
+
+            if (keys[GLFW_KEY_RIGHT] && playFrame + 1 < player->getFrameCount())
+                playFrame++;
+            else if (keys[GLFW_KEY_LEFT] && playFrame > 0)
+                playFrame--;
+            else if (!paused && playFrame + 1 < player->getFrameCount())
+                playFrame++;
+        }
+        else if(run) {
+            // Lets go of the first particle still pinned
+            if (releasePin) {
+                releasePin = false;
+                for (GLuint p = 0; p < world->getParticleCount(); p++) {
+                    if (world->isPinned(p)) {
+                        world->setPinned(p, false);
+                        break;
                     }
-
-                    // Add gravity
-                    theForce += gravity;
-
-                    // Set the current acceleration of the particle
-                    theParticles[i][j].setAcc((1 / m) * (theForce));
                 }
             }
+            {
+                PROFILE_SCOPE(PHASE_SIMULATE);
+                world->step(state == GLFW_PRESS);
+            }
+            {
+                PROFILE_SCOPE(PHASE_PACK);
+                // Tearing adds particles
+                framePositions.resize(3 * world->getParticleCount());
+                world->getPositions(framePositions.data());
+            }
 
-            GLfloat line_vertices[6 * clothHeight * clothWidth];
-            GLuint counter = 0;
-
-            for (GLuint i = 0; i < clothHeight; i++) {
-                for (GLuint j = 0; j < clothWidth; j++) {
-                    if (!theParticles[i][j].isStationary()) {
-                        // Set the new positions and velocities of the particles
-                        theParticles[i][j].setPos(
-                                RungeKuttaForPosDiff(theParticles[i][j], h) + theParticles[i][j].getPos());
-                        theParticles[i][j].setVel(RungeKuttaForVel(theParticles[i][j], h));
-                    }
+            // Hand the frame to the cache and the exporter, their writer threads do the disk work
+            if (recorder)
+                recorder->append(framePositions.data());
+            if (exporter)
+                exporter->submit(exportFrame++, framePositions.data());
+        }
 
-                    line_vertices[counter++] = theParticles[i][j].getPos().x;
-                    line_vertices[counter++] = theParticles[i][j].getPos().y;
-                    line_vertices[counter++] = theParticles[i][j].getPos().z;
-                    line_vertices[counter++] = 1.0f;
-                    line_vertices[counter++] = 1.0f;
-                    line_vertices[counter++] = 1.0f;
+        if(run) {
+            GLuint vertexCount = (GLuint)framePositions.size() / 3;
+            line_vertices.resize(6 * vertexCount);
+            {
+                PROFILE_SCOPE(PHASE_PACK);
+                for (GLuint p = 0; p < vertexCount; p++) {
+                    line_vertices[6 * p] = framePositions[3 * p];
+                    line_vertices[6 * p + 1] = framePositions[3 * p + 1];
+                    line_vertices[6 * p + 2] = framePositions[3 * p + 2];
+                    line_vertices[6 * p + 3] = 1.0f;
+                    line_vertices[6 * p + 4] = 1.0f;
+                    line_vertices[6 * p + 5] = 1.0f;
                 }
             }
 
+            PROFILE_SCOPE(PHASE_UPLOAD);
+            gpuProfiler->begin();
             glBindVertexArray(VAO);
             glBindBuffer(GL_ARRAY_BUFFER, VBO); // Bind a buffer to the ID
-            glBufferData(GL_ARRAY_BUFFER, sizeof(line_vertices), line_vertices,
+            glBufferData(GL_ARRAY_BUFFER, line_vertices.size() * sizeof(GLfloat), line_vertices.data(),
                          GL_STREAM_DRAW); // Copies the vertices data into the buffer
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+            world->takeChangedTriangles(changedTriangles);
+            for (GLuint first = 0; first < changedTriangles.size();) {
+                // Runs of consecutive triangles go in one upload
+                GLuint last = first;
+                while (last + 1 < changedTriangles.size() && changedTriangles[last + 1] == changedTriangles[last] + 1)
+                    last++;
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 3 * changedTriangles[first] * sizeof(GLuint),
+                                3 * (last - first + 1) * sizeof(GLuint), &indices[3 * changedTriangles[first]]);
+                first = last + 1;
+            }
 
             glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid *) 0); // Positions
             glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
@@ -317,20 +460,35 @@ int main()
             glEnableVertexAttribArray(0);
             glEnableVertexAttribArray(1);
 
-            glDrawElements(GL_TRIANGLES, 6 * (clothHeight - 1) * (clothWidth - 1), GL_UNSIGNED_INT, 0);
+            glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(),
+                                (GLsizei)drawCounts.size());
 
             // Unbind VAO
             glBindVertexArray(0);
+            gpuProfiler->end();
         }
         // Swap front and back buffers
-        glfwSwapBuffers(window);
-
+        {
+            PROFILE_SCOPE(PHASE_SWAP);
+            glfwSwapBuffers(window);
+        }
     }
 
+    // Write whatever is left of the recording
+    if (recorder)
+        recorder->close();
+    if (exporter)
+        exporter->close();
+
+    PROFILE_REPORT(std::cout);
+    if (!traceFile.empty())
+        PROFILE_TRACE(traceFile);
+
     // Properly de-allocate all resources once they've outlived their purpose
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    gpuProfiler.reset();
 
     // Terminate GLFW, clearing any resources allocated by GLFW.
     glfwTerminate();
@@ -342,6 +500,139 @@ int main()
  ******** Function initialisation **********
  *******************************************/
 
+// Simulates the scene without threads and then on pools of 1 to maxThreads threads, and checks that
+// every run ends in exactly the same state. With pinToNodes the pools are spread over the NUMA nodes.
+bool check_determinism(const Scene& scene, GLuint frames, GLuint maxThreads, bool pinToNodes) {
+    if (maxThreads == 0)
+        maxThreads = std::max(std::thread::hardware_concurrency(), 4u);
+
+    std::cout << "Simulating " << frames << " frames of " << scene.name << " with 0 to " << maxThreads
+              << " threads" << std::endl << std::setw(10) << "threads" << std::setw(20) << "state hash" << std::endl;
+
+    uint64_t reference = 0;
+    bool identical = true;
+    for (GLuint threads = 0; threads <= maxThreads; threads++) {
+        std::unique_ptr<World> world = World::create(scene);
+        std::unique_ptr<ThreadPool> pool;
+        if (threads > 0) {
+            pool.reset(pinToNodes ? new ThreadPool(threads, NumaTopology::detect()) : new ThreadPool(threads));
+            world->setThreadPool(pool.get());
+        }
+        for (GLuint f = 0; f < frames; f++)
+            world->step(false);
+
+        uint64_t hash = world->getStateHash();
+        if (threads == 0)
+            reference = hash;
+        std::cout << std::setw(10) << threads << "    " << std::hex << std::setfill('0') << std::setw(16) << hash
+                  << std::setfill(' ') << std::dec
+                  << (hash == reference ? "" : "  differs") << std::endl;
+        identical = identical && hash == reference;
+    }
+
+    std::cout << (identical ? "All runs are identical" : "Runs differ") << std::endl;
+    return identical;
+}
+
+// Simulates the scene in this process and then split into bands over 2 to maxProcesses processes,
+// and checks that every run ends in exactly the same state
+bool check_processes(const Scene& scene, GLuint frames, GLuint maxProcesses) {
+    std::cout << "Simulating " << frames << " frames of " << scene.name << " in 1 to " << maxProcesses
+              << " processes" << std::endl << std::setw(10) << "processes" << std::setw(20) << "state hash"
+              << std::setw(12) << "ms" << std::endl;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_ptr<World> world = World::create(scene);
+    for (GLuint f = 0; f < frames; f++)
+        world->step(false);
+    uint64_t reference = world->getStateHash();
+    std::cout << std::setw(10) << 1 << "    " << std::hex << std::setfill('0') << std::setw(16) << reference
+              << std::setfill(' ') << std::dec << std::setw(12) << std::fixed << std::setprecision(1)
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << std::defaultfloat << std::setprecision(6) << std::endl;
+
+    // A scene that cannot be split has nothing to compare, the counts it can be split into are compared
+    bool identical = true;
+    GLuint compared = 1;
+    for (GLuint processes = 2; processes <= maxProcesses; processes++) {
+        start = std::chrono::steady_clock::now();
+        Decomposition decomposition(scene, processes);
+        if (!decomposition.canSplit()) {
+            std::cout << std::setw(10) << processes << "    unsupported" << std::endl;
+            break;
+        }
+        compared = processes;
+        bool running = decomposition.start();
+        for (GLuint f = 0; f < frames && running; f++)
+            running = decomposition.step();
+        decomposition.stop();
+        if (!running) {
+            std::cout << std::setw(10) << processes << "    failed" << std::endl;
+            identical = false;
+            continue;
+        }
+
+        uint64_t hash = decomposition.getStateHash();
+        std::cout << std::setw(10) << processes << "    " << std::hex << std::setfill('0') << std::setw(16) << hash
+                  << std::setfill(' ') << std::dec << std::setw(12) << std::fixed << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << std::defaultfloat << std::setprecision(6) << (hash == reference ? "" : "  differs") << std::endl;
+        identical = identical && hash == reference;
+    }
+
+    if (compared == 1) {
+        std::cout << "The scene cannot be split over processes" << std::endl;
+        return false;
+    }
+    if (!identical)
+        std::cout << "Runs differ" << std::endl;
+    else if (compared < maxProcesses)
+        std::cout << "All runs up to " << compared << " processes are identical" << std::endl;
+    else
+        std::cout << "All runs are identical" << std::endl;
+    return identical;
+}
+
+// Simulates the scene with exact and with quantised rest lengths and reports what the quantisation
+// saves and how far the quantised run ends up from the exact one. Fails only when a run blows up.
+bool check_quantisation(const Scene& scene, GLuint frames) {
+    std::cout << "Simulating " << frames << " frames of " << scene.name << " with exact and quantised rest lengths"
+              << std::endl << std::setw(10) << "lengths" << std::setw(14) << "spring bytes" << std::setw(14)
+              << "length error" << std::setw(12) << "strain" << std::setw(14) << "energy" << std::endl;
+
+    const char* names[2] = {"exact", "quantised"};
+    std::vector<GLfloat> positions[2];
+    bool finite = true;
+    for (GLuint run = 0; run < 2; run++) {
+        Scene runScene = scene;
+        runScene.solver.quantisedRestLengths = run == 1;
+        std::unique_ptr<World> world = World::create(runScene);
+        for (GLuint f = 0; f < frames; f++)
+            world->step(false);
+
+        positions[run].resize(3 * world->getParticleCount());
+        world->getPositions(positions[run].data());
+        for (GLuint i = 0; i < positions[run].size(); i++)
+            finite = finite && std::isfinite(positions[run][i]);
+        std::cout << std::setw(10) << names[run] << std::setw(14) << world->getSpringBytes() << std::setw(14)
+                  << world->getRestLengthError() << std::setw(12) << world->getMaxStrain() << std::setw(14)
+                  << world->getEnergy() << std::endl;
+    }
+
+    // Tearing may split the cloths at different frames, then the particles no longer correspond
+    if (positions[0].size() != positions[1].size()) {
+        std::cout << "The runs tore differently, their particles cannot be compared" << std::endl;
+    } else {
+        GLfloat deviation = 0.0f;
+        for (GLuint i = 0; i < positions[0].size(); i++)
+            deviation = std::max(deviation, std::fabs(positions[1][i] - positions[0][i]));
+        std::cout << "Largest difference of a position " << deviation << std::endl;
+    }
+    if (!finite)
+        std::cout << "A run blew up" << std::endl;
+    return finite;
+}
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode) {
     // When a user presses the escape key, we set the WindowShouldClose property to true,
     // closing the application
@@ -349,6 +640,10 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         glfwSetWindowShouldClose(window, GL_TRUE);
     if(key == GLFW_KEY_SPACE && action == GLFW_PRESS)
         run = true;
+    if(key == GLFW_KEY_P && action == GLFW_PRESS)
+        paused = !paused;
+    if(key == GLFW_KEY_R && action == GLFW_PRESS)
+        releasePin = true;
 
     if(action == GLFW_PRESS)
         keys[key] = true;
@@ -387,42 +682,3 @@ void do_movement() {
     if(keys[GLFW_KEY_D])
         camera.ProcessKeyboard(RIGHT,deltaTime);
 }
-
-// Calculates the spring force acting on a particle
-glm::vec3 theSpringForce(Particle p1, Particle p2, GLfloat L0, GLfloat k){
-    GLfloat lengthBParticles = sqrtf(GLfloat(pow(p2.getPos().x-p1.getPos().x,2) + pow(p2.getPos().y-p1.getPos().y,2) + pow(p2.getPos().z-p1.getPos().z,2)));
-    glm::vec3 length = p2.getPos() - p1.getPos();
-
-    glm::vec3 Fk = k*(lengthBParticles-L0)*(normalize(length));
-    return Fk;
-}
-
-// Calculates the damping force acting on a particle
-glm::vec3 theDampForce(Particle p1, Particle p2, GLfloat b){
-    glm::vec3 Fb = b * (p1.getVel() - p2.getVel());
-    return Fb;
-}
-
-// Calculate the new velocity using RK4
-glm::vec3 RungeKuttaForVel(Particle p, GLfloat h){
-    glm::vec3 next, k1, k2, k3, k4;
-
-    k1 = p.getAcc();
-    k2 = p.getAcc() + (h/2.0f)*k1;
-    k3 = p.getAcc() + (h/2.0f)*k2;
-    k4 = p.getAcc() + h*k3;
-    next = p.getVel() + (h/6.0f)*(k1 + 2.0f*k2 + 2.0f*k3 + k4);
-
-    return next;
-}
-
-// Calculate the difference between the new position and the old one using RK4
-glm::vec3 RungeKuttaForPosDiff(Particle p, GLfloat h){
-    glm::vec3 next, k1, k2, k3, k4;
-    k1 = p.getVel();
-    k2 = p.getVel() + (h/2.0f)*k1;
-    k3 = p.getVel() + (h/2.0f)*k2;
-    k4 = p.getVel() + h*k3;
-    next = (h/6.0f)*(k1 + 2.0f*k2 + 2.0f*k3 + k4);
-    return next;
-}
\ No newline at end of file
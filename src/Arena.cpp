@@ -0,0 +1,73 @@
+#include "Arena.h"
+
+#include <new>
+
+Arena::Arena(size_t theCapacity) : buffer(nullptr), capacity(0), used(0), peak(0), overflowBytes(0) {
+    reserve(theCapacity);
+}
+
+Arena::~Arena() {
+    reset();
+    ::operator delete(buffer);
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+    size_t start = (used + alignment - 1) / alignment * alignment;
+    if (start + bytes <= capacity) {
+        used = start + bytes;
+        if (used + overflowBytes > peak)
+            peak = used + overflowBytes;
+        return buffer + start;
+    }
+
+    // Full, the memory comes from the heap until the next reset makes room. It goes through operator new
+    // like any other allocation, so builds that count allocations see a step that overflowed.
+    void* block = ::operator new(bytes + alignment);
+    overflow.push_back(block);
+    overflowBytes += bytes + alignment;
+    if (used + overflowBytes > peak)
+        peak = used + overflowBytes;
+    size_t address = (size_t)block;
+    return (char*)block + ((address + alignment - 1) / alignment * alignment - address);
+}
+
+void Arena::reset() {
+    for (size_t i = 0; i < overflow.size(); i++)
+        ::operator delete(overflow[i]);
+    overflow.clear();
+    overflowBytes = 0;
+    used = 0;
+
+    if (peak > capacity)
+        reserve(peak);
+    peak = 0;
+}
+
+Arena::Marker Arena::getMarker() {
+    Marker marker = {used, overflow.size(), overflowBytes};
+    return marker;
+}
+
+void Arena::rewind(Marker marker) {
+    // The peak is kept so the next reset still makes room for what was needed
+    while (overflow.size() > marker.overflowCount) {
+        ::operator delete(overflow.back());
+        overflow.pop_back();
+    }
+    overflowBytes = marker.overflowBytes;
+    used = marker.used;
+}
+
+void Arena::reserve(size_t theCapacity) {
+    if (theCapacity > capacity && used == 0) {
+        ::operator delete(buffer);
+        buffer = nullptr;
+        capacity = 0;
+        buffer = static_cast<char*>(::operator new(theCapacity));
+        capacity = theCapacity;
+    }
+}
+
+size_t Arena::getCapacity() {
+    return capacity;
+}
@@ -0,0 +1,992 @@
+#include "ClothMesh.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+#include <cctype>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Text is parsed in chunks of about this many bytes
+static const size_t CHUNK_SIZE = 1 << 20;
+
+// Binary records are parsed in blocks of this many
+static const size_t RECORD_BLOCK = 1 << 16;
+
+// The bytes of a file, mapped into memory read only
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), size(0) {}
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& fileName);
+    const char* begin() { return data; }
+    const char* end() { return data + size; }
+
+private:
+    char* data;
+    size_t size;
+#ifdef _WIN32
+    std::vector<char> contents;
+#endif
+};
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile() {}
+
+// Without mmap the file is read into memory
+bool MappedFile::open(const std::string& fileName) {
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = contents.data();
+    size = contents.size();
+    return true;
+}
+
+#else
+
+MappedFile::~MappedFile() {
+    if (data)
+        munmap(data, size);
+}
+
+bool MappedFile::open(const std::string& fileName) {
+    int file = ::open(fileName.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    if (fstat(file, &status) != 0) {
+        close(file);
+        return false;
+    }
+    size = (size_t)status.st_size;
+    if (size > 0) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapped == MAP_FAILED) {
+            close(file);
+            size = 0;
+            return false;
+        }
+        // Every thread reads its own part, the pages are wanted all at once rather than in order
+        madvise(mapped, size, MADV_WILLNEED);
+        data = static_cast<char*>(mapped);
+    }
+    close(file);
+    return true;
+}
+
+#endif
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && isSpace(*p))
+        p++;
+    return p;
+}
+
+static const char* findLineEnd(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline ? newline : end;
+}
+
+// True if the line at p starts with the keyword c on its own, as "v" in "v 1 2 3" but not in "vt 0 1"
+static bool isKeyword(const char* p, const char* end, char c) {
+    return p < end && *p == c && (p + 1 == end || isSpace(p[1]));
+}
+
+static GLuint countTokens(const char* p, const char* end) {
+    GLuint tokens = 0;
+    while (true) {
+        p = skipSpaces(p, end);
+        if (p == end)
+            return tokens;
+        tokens++;
+        while (p < end && !isSpace(*p))
+            p++;
+    }
+}
+
+static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Parses a decimal number at p and moves p past it. With at most 15 significant digits and a
+// power of ten up to 22 the value is one product or quotient of two exact doubles, so rounded
+// correctly, anything else goes to strtod.
+static bool parseNumber(const char*& p, const char* end, double& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any = true;
+        if (digits < 19) {
+            mantissa = 10 * mantissa + (*p - '0');
+            if (mantissa != 0)
+                digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = 10 * mantissa + (*p - '0');
+                if (mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        p = start;
+        return false;
+    }
+    if (p + 1 < end && (*p == 'e' || *p == 'E')) {
+        const char* mark = p++;
+        bool negativeExponent = false;
+        if (*p == '-' || *p == '+') {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if (p < end && *p >= '0' && *p <= '9') {
+            int power = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; p++) {
+                if (power < 10000)
+                    power = 10 * power + (*p - '0');
+            }
+            exponent += negativeExponent ? -power : power;
+        } else {
+            p = mark;
+        }
+    }
+
+    if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+        value = exponent >= 0 ? (double)mantissa * POWERS_OF_TEN[exponent] : (double)mantissa / POWERS_OF_TEN[-exponent];
+        if (negative)
+            value = -value;
+    } else {
+        char buffer[64];
+        size_t length = std::min((size_t)(p - start), sizeof(buffer) - 1);
+        std::memcpy(buffer, start, length);
+        buffer[length] = 0;
+        value = std::strtod(buffer, nullptr);
+    }
+    return true;
+}
+
+static bool parseInteger(const char*& p, const char* end, long long& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    long long magnitude = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any = true;
+        if (magnitude < (1LL << 40))
+            magnitude = 10 * magnitude + (*p - '0');
+    }
+    if (!any) {
+        p = start;
+        return false;
+    }
+    value = negative ? -magnitude : magnitude;
+    return true;
+}
+
+// Cuts [begin, end) into chunks of about CHUNK_SIZE bytes that start at the beginning of a line,
+// chunk c is [starts[c], starts[c + 1])
+static std::vector<const char*> chunkStarts(const char* begin, const char* end) {
+    std::vector<const char*> starts(1, begin);
+    while ((size_t)(end - starts.back()) > CHUNK_SIZE) {
+        const char* p = starts.back() + CHUNK_SIZE;
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!newline || newline + 1 == end)
+            break;
+        starts.push_back(newline + 1);
+    }
+    starts.push_back(end);
+    return starts;
+}
+
+// What a chunk of text holds and where that goes, and the first error in it
+struct TextChunk {
+    size_t lines, vertices, triangles;
+    size_t firstLine, firstVertex, firstTriangle;
+    size_t errorLine; // 0 without an error
+    const char* error;
+};
+
+// Numbers the lines, vertices and triangles of the chunks from those of the chunks before them.
+// False if the mesh is too large for 32 bit indices.
+static bool numberChunks(std::vector<TextChunk>& chunks, size_t firstLine, size_t& vertexCount,
+                         size_t& triangleCount) {
+    size_t line = firstLine;
+    vertexCount = 0;
+    triangleCount = 0;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        chunks[c].firstLine = line;
+        chunks[c].firstVertex = vertexCount;
+        chunks[c].firstTriangle = triangleCount;
+        line += chunks[c].lines;
+        vertexCount += chunks[c].vertices;
+        triangleCount += chunks[c].triangles;
+    }
+    return vertexCount < UINT32_MAX && 3 * triangleCount < UINT32_MAX;
+}
+
+// Reports the error of the first chunk that has one
+static bool reportChunkErrors(const std::string& fileName, const std::vector<TextChunk>& chunks) {
+    for (size_t c = 0; c < chunks.size(); c++) {
+        if (chunks[c].errorLine != 0) {
+            std::cerr << fileName << ":" << chunks[c].errorLine << ": " << chunks[c].error << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClothMesh::read(std::string fileName, GLuint threadCount) {
+    positions.clear();
+    indices.clear();
+    springs.clear();
+    diagonals.clear();
+
+    MappedFile file;
+    if (!file.open(fileName)) {
+        std::cerr << "Could not open mesh " << fileName << std::endl;
+        return false;
+    }
+
+    std::string extension;
+    size_t dot = fileName.find_last_of('.');
+    if (dot != std::string::npos)
+        extension = fileName.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    ThreadPool pool(threadCount);
+    bool read;
+    if (extension == "obj") {
+        read = readObj(fileName, file.begin(), file.end(), pool);
+    } else if (extension == "ply") {
+        read = readPly(fileName, file.begin(), file.end(), pool);
+    } else {
+        std::cerr << fileName << ": only .obj and .ply meshes can be read" << std::endl;
+        return false;
+    }
+    if (!read)
+        return false;
+    if (indices.empty()) {
+        std::cerr << fileName << ": the mesh has no faces" << std::endl;
+        return false;
+    }
+
+    lowest = glm::vec3(FLT_MAX);
+    highest = glm::vec3(-FLT_MAX);
+    for (GLuint v = 0; v < positions.size(); v++) {
+        const glm::vec3& position = positions[v];
+        if (!std::isfinite(position.x) || !std::isfinite(position.y) || !std::isfinite(position.z)) {
+            std::cerr << fileName << ": vertex " << v << " is not finite" << std::endl;
+            return false;
+        }
+        lowest = glm::min(lowest, position);
+        highest = glm::max(highest, position);
+    }
+    glm::vec3 centre = 0.5f * (lowest + highest);
+    middle = 0;
+    for (GLuint v = 1; v < positions.size(); v++) {
+        if (glm::length(positions[v] - centre) < glm::length(positions[middle] - centre))
+            middle = v;
+    }
+
+    bool found = findSprings(fileName);
+    std::vector<unsigned char>().swap(diagonals);
+    return found;
+}
+
+bool ClothMesh::readObj(const std::string& fileName, const char* begin, const char* end, ThreadPool& pool) {
+    std::vector<const char*> starts = chunkStarts(begin, end);
+    std::vector<TextChunk> chunks(starts.size() - 1);
+
+    // Lines, vertices and triangles of every chunk
+    pool.parallelFor((GLuint)chunks.size(), 1, [&](GLuint first, GLuint last) {
+        for (GLuint c = first; c < last; c++) {
+            TextChunk& chunk = chunks[c];
+            chunk.lines = chunk.vertices = chunk.triangles = chunk.errorLine = 0;
+            for (const char* line = starts[c]; line < starts[c + 1]; chunk.lines++) {
+                const char* lineEnd = findLineEnd(line, starts[c + 1]);
+                const char* p = skipSpaces(line, lineEnd);
+                if (isKeyword(p, lineEnd, 'v')) {
+                    chunk.vertices++;
+                } else if (isKeyword(p, lineEnd, 'f')) {
+                    GLuint corners = countTokens(p + 1, lineEnd);
+                    if (corners >= 3)
+                        chunk.triangles += corners - 2;
+                }
+                line = lineEnd + 1;
+            }
+        }
+    });
+
+    size_t vertexCount, triangleCount;
+    if (!numberChunks(chunks, 0, vertexCount, triangleCount)) {
+        std::cerr << fileName << ": the mesh is too large" << std::endl;
+        return false;
+    }
+    positions.resize(vertexCount);
+    indices.resize(3 * triangleCount);
+    diagonals.resize(triangleCount);
+
+    // Every chunk parses into its own range of the arrays. OBJ numbers the vertices from 1, or
+    // backwards from the last vertex before the face with negative numbers.
+    pool.parallelFor((GLuint)chunks.size(), 1, [&](GLuint first, GLuint last) {
+        std::vector<GLuint> corners;
+        for (GLuint c = first; c < last; c++) {
+            TextChunk& chunk = chunks[c];
+            size_t vertex = chunk.firstVertex, triangle = chunk.firstTriangle, line = chunk.firstLine;
+            for (const char* lineStart = starts[c]; lineStart < starts[c + 1] && chunk.errorLine == 0; line++) {
+                const char* lineEnd = findLineEnd(lineStart, starts[c + 1]);
+                const char* p = skipSpaces(lineStart, lineEnd);
+                lineStart = lineEnd + 1;
+
+                if (isKeyword(p, lineEnd, 'v')) {
+                    double coordinates[3] = {0.0, 0.0, 0.0};
+                    p++;
+                    for (GLuint i = 0; i < 3 && chunk.errorLine == 0; i++) {
+                        p = skipSpaces(p, lineEnd);
+                        if (!parseNumber(p, lineEnd, coordinates[i]) || (p < lineEnd && !isSpace(*p))) {
+                            chunk.errorLine = line + 1;
+                            chunk.error = "expected the three coordinates of a vertex";
+                        }
+                    }
+                    positions[vertex++] = glm::vec3(coordinates[0], coordinates[1], coordinates[2]);
+                } else if (isKeyword(p, lineEnd, 'f')) {
+                    // Only the vertex of every corner is used, texture coordinates and normals are skipped
+                    corners.clear();
+                    p = skipSpaces(p + 1, lineEnd);
+                    while (p < lineEnd) {
+                        long long index;
+                        if (!parseInteger(p, lineEnd, index) || (p < lineEnd && !isSpace(*p) && *p != '/')) {
+                            chunk.errorLine = line + 1;
+                            chunk.error = "expected the vertex numbers of a face";
+                            break;
+                        }
+                        long long resolved = index > 0 ? index - 1 : (long long)vertex + index;
+                        if (index == 0 || resolved < 0 || resolved >= (long long)vertexCount) {
+                            chunk.errorLine = line + 1;
+                            chunk.error = "a face refers to a vertex that does not exist";
+                            break;
+                        }
+                        corners.push_back((GLuint)resolved);
+                        while (p < lineEnd && !isSpace(*p))
+                            p++;
+                        p = skipSpaces(p, lineEnd);
+                    }
+                    if (chunk.errorLine == 0 && corners.size() < 3) {
+                        chunk.errorLine = line + 1;
+                        chunk.error = "a face needs at least three corners";
+                    }
+                    if (chunk.errorLine == 0) {
+                        addPolygon(corners.data(), (GLuint)corners.size(), triangle);
+                        triangle += corners.size() - 2;
+                    }
+                }
+            }
+        }
+    });
+    return reportChunkErrors(fileName, chunks);
+}
+
+enum PlyType {
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+struct PlyProperty {
+    std::string name;
+    PlyType type;      // of the values of a list
+    bool list;
+    PlyType countType; // of the count of a list
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+static bool parsePlyType(const std::string& name, PlyType& type) {
+    static const char* const NAMES[][2] = {{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"},
+                                           {"ushort", "uint16"}, {"int", "int32"}, {"uint", "uint32"},
+                                           {"float", "float32"}, {"double", "float64"}};
+    for (int t = 0; t < 8; t++) {
+        if (name == NAMES[t][0] || name == NAMES[t][1]) {
+            type = (PlyType)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t plySize(PlyType type) {
+    static const size_t SIZES[] = {1, 1, 2, 2, 4, 4, 4, 8};
+    return SIZES[type];
+}
+
+// The binary value of type at p, stored in the other byte order when swapped
+static double readPlyValue(const char* p, PlyType type, bool swapped) {
+    unsigned char bytes[8];
+    size_t size = plySize(type);
+    std::memcpy(bytes, p, size);
+    if (swapped)
+        std::reverse(bytes, bytes + size);
+    switch (type) {
+        case PLY_INT8: { int8_t value; std::memcpy(&value, bytes, size); return value; }
+        case PLY_UINT8: { uint8_t value; std::memcpy(&value, bytes, size); return value; }
+        case PLY_INT16: { int16_t value; std::memcpy(&value, bytes, size); return value; }
+        case PLY_UINT16: { uint16_t value; std::memcpy(&value, bytes, size); return value; }
+        case PLY_INT32: { int32_t value; std::memcpy(&value, bytes, size); return value; }
+        case PLY_UINT32: { uint32_t value; std::memcpy(&value, bytes, size); return value; }
+        case PLY_FLOAT32: { float value; std::memcpy(&value, bytes, size); return value; }
+        default: { double value; std::memcpy(&value, bytes, size); return value; }
+    }
+}
+
+// Moves p past one binary record of element, false if the record runs past end
+static bool skipPlyRecord(const char*& p, const char* end, const PlyElement& element, bool swapped) {
+    for (size_t i = 0; i < element.properties.size(); i++) {
+        const PlyProperty& property = element.properties[i];
+        size_t bytes = plySize(property.type);
+        if (property.list) {
+            size_t countSize = plySize(property.countType);
+            if ((size_t)(end - p) < countSize)
+                return false;
+            double count = readPlyValue(p, property.countType, swapped);
+            p += countSize;
+            if (count < 0.0)
+                return false;
+            bytes *= (size_t)count;
+        }
+        if ((size_t)(end - p) < bytes)
+            return false;
+        p += bytes;
+    }
+    return true;
+}
+
+static size_t findPlyProperty(const PlyElement& element, const std::string& name) {
+    for (size_t i = 0; i < element.properties.size(); i++) {
+        if (element.properties[i].name == name)
+            return i;
+    }
+    return SIZE_MAX;
+}
+
+// Reads the properties of one ASCII record at p, the scalars into values and the list of
+// property listProperty into list. The other lists are parsed and dropped.
+static bool readAsciiRecord(const char* p, const char* end, const PlyElement& element, size_t listProperty,
+                            double* values, std::vector<long long>& list) {
+    list.clear();
+    for (size_t i = 0; i < element.properties.size(); i++) {
+        const PlyProperty& property = element.properties[i];
+        p = skipSpaces(p, end);
+        if (!property.list) {
+            if (!parseNumber(p, end, values[i]) || (p < end && !isSpace(*p)))
+                return false;
+            continue;
+        }
+        long long count;
+        if (!parseInteger(p, end, count) || count < 0 || (p < end && !isSpace(*p)))
+            return false;
+        for (long long n = 0; n < count; n++) {
+            p = skipSpaces(p, end);
+            double value;
+            if (!parseNumber(p, end, value) || (p < end && !isSpace(*p)))
+                return false;
+            if (i == listProperty)
+                list.push_back((long long)value);
+        }
+    }
+    return skipSpaces(p, end) == end;
+}
+
+bool ClothMesh::readPly(const std::string& fileName, const char* begin, const char* end, ThreadPool& pool) {
+    // The header is text up to the end_header line
+    std::vector<PlyElement> elements;
+    bool ascii = false, swapped = false, formatSeen = false;
+    const char* p = begin;
+    size_t headerLines = 0;
+    while (true) {
+        if (p >= end) {
+            std::cerr << fileName << ": the PLY header has no end_header" << std::endl;
+            return false;
+        }
+        const char* lineEnd = findLineEnd(p, end);
+        std::istringstream line(std::string(p, lineEnd));
+        p = lineEnd + 1;
+        headerLines++;
+
+        std::string keyword;
+        line >> keyword;
+        bool valid = true;
+        if (headerLines == 1) {
+            valid = keyword == "ply";
+        } else if (keyword == "format") {
+            std::string format;
+            line >> format;
+            formatSeen = true;
+            ascii = format == "ascii";
+            uint16_t probe = 1;
+            bool littleHost = *reinterpret_cast<unsigned char*>(&probe) == 1;
+            if (format == "binary_little_endian")
+                swapped = !littleHost;
+            else if (format == "binary_big_endian")
+                swapped = littleHost;
+            else
+                valid = ascii;
+        } else if (keyword == "element") {
+            PlyElement element;
+            line >> element.name >> element.count;
+            valid = !line.fail();
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            PlyProperty property;
+            std::string type;
+            line >> type;
+            property.list = type == "list";
+            if (property.list) {
+                std::string countType;
+                line >> countType >> type;
+                valid = parsePlyType(countType, property.countType) && property.countType <= PLY_UINT32;
+            }
+            line >> property.name;
+            valid = valid && !line.fail() && parsePlyType(type, property.type) && !elements.empty();
+            if (valid)
+                elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            break;
+        } else {
+            valid = keyword.empty() || keyword == "comment" || keyword == "obj_info";
+        }
+        if (!valid) {
+            std::cerr << fileName << ":" << headerLines << ": not a valid PLY header line" << std::endl;
+            return false;
+        }
+    }
+    if (p > end)
+        p = end;
+
+    // The vertices need x, y and z and the faces a list of vertex numbers
+    size_t vertexElement = SIZE_MAX, faceElement = SIZE_MAX;
+    size_t propertyX = SIZE_MAX, propertyY = SIZE_MAX, propertyZ = SIZE_MAX, propertyCorners = SIZE_MAX;
+    for (size_t e = 0; e < elements.size(); e++) {
+        if (elements[e].name == "vertex" && vertexElement == SIZE_MAX) {
+            vertexElement = e;
+            propertyX = findPlyProperty(elements[e], "x");
+            propertyY = findPlyProperty(elements[e], "y");
+            propertyZ = findPlyProperty(elements[e], "z");
+        } else if (elements[e].name == "face" && faceElement == SIZE_MAX) {
+            faceElement = e;
+            propertyCorners = findPlyProperty(elements[e], "vertex_indices");
+            if (propertyCorners == SIZE_MAX)
+                propertyCorners = findPlyProperty(elements[e], "vertex_index");
+        }
+    }
+    if (!formatSeen || vertexElement == SIZE_MAX || faceElement == SIZE_MAX || propertyX == SIZE_MAX
+        || propertyY == SIZE_MAX || propertyZ == SIZE_MAX || propertyCorners == SIZE_MAX
+        || !elements[faceElement].properties[propertyCorners].list) {
+        std::cerr << fileName << ": a PLY mesh needs vertices with x, y and z and faces with vertex_indices"
+                  << std::endl;
+        return false;
+    }
+    size_t vertexCount = elements[vertexElement].count;
+    if (vertexCount >= UINT32_MAX) {
+        std::cerr << fileName << ": the mesh is too large" << std::endl;
+        return false;
+    }
+    positions.resize(vertexCount);
+    const PlyElement& vertices = elements[vertexElement];
+    const PlyElement& faces = elements[faceElement];
+
+    if (ascii) {
+        // Every record is a line: the lines of every chunk give the element and record of each
+        std::vector<const char*> starts = chunkStarts(p, end);
+        std::vector<TextChunk> chunks(starts.size() - 1);
+        pool.parallelFor((GLuint)chunks.size(), 1, [&](GLuint first, GLuint last) {
+            for (GLuint c = first; c < last; c++) {
+                chunks[c].lines = chunks[c].vertices = chunks[c].triangles = chunks[c].errorLine = 0;
+                for (const char* line = starts[c]; line < starts[c + 1]; line = findLineEnd(line, starts[c + 1]) + 1)
+                    chunks[c].lines++;
+            }
+        });
+        size_t ignored;
+        numberChunks(chunks, 0, ignored, ignored);
+        std::vector<size_t> elementFirstLine(elements.size() + 1, 0);
+        for (size_t e = 0; e < elements.size(); e++)
+            elementFirstLine[e + 1] = elementFirstLine[e] + elements[e].count;
+        size_t vertexLine = elementFirstLine[vertexElement], faceLine = elementFirstLine[faceElement];
+        size_t lineCount = chunks.empty() ? 0 : chunks.back().firstLine + chunks.back().lines;
+        if (lineCount < elementFirstLine[elements.size()]) {
+            std::cerr << fileName << ": the PLY file ends before its last record" << std::endl;
+            return false;
+        }
+
+        // Two passes over the records, the first counts the triangles of the faces of every chunk
+        // and the second parses the vertices and faces
+        for (int pass = 0; pass < 2; pass++) {
+            if (pass == 1) {
+                size_t triangleCount = 0;
+                for (size_t c = 0; c < chunks.size(); c++) {
+                    chunks[c].firstTriangle = triangleCount;
+                    triangleCount += chunks[c].triangles;
+                }
+                if (!reportChunkErrors(fileName, chunks))
+                    return false;
+                if (3 * triangleCount >= UINT32_MAX) {
+                    std::cerr << fileName << ": the mesh is too large" << std::endl;
+                    return false;
+                }
+                indices.resize(3 * triangleCount);
+                diagonals.resize(triangleCount);
+            }
+            pool.parallelFor((GLuint)chunks.size(), 1, [&](GLuint first, GLuint last) {
+                std::vector<double> values(std::max(vertices.properties.size(), faces.properties.size()));
+                std::vector<long long> list;
+                std::vector<GLuint> corners;
+                for (GLuint c = first; c < last; c++) {
+                    TextChunk& chunk = chunks[c];
+                    size_t triangle = chunk.firstTriangle;
+                    const char* lineStart = starts[c];
+                    for (size_t line = chunk.firstLine; line < chunk.firstLine + chunk.lines && chunk.errorLine == 0; line++) {
+                        const char* lineEnd = findLineEnd(lineStart, starts[c + 1]);
+                        const char* record = lineStart;
+                        lineStart = lineEnd + 1;
+                        bool isVertex = line >= vertexLine && line < vertexLine + vertexCount;
+                        bool isFace = line >= faceLine && line < faceLine + faces.count;
+                        if ((pass == 0 && !isFace) || (!isVertex && !isFace))
+                            continue;
+
+                        if (!readAsciiRecord(record, lineEnd, isVertex ? vertices : faces,
+                                             isVertex ? SIZE_MAX : propertyCorners, values.data(), list)) {
+                            chunk.errorLine = headerLines + line + 1;
+                            chunk.error = "not a valid record";
+                        } else if (isVertex) {
+                            positions[line - vertexLine] = glm::vec3(values[propertyX], values[propertyY], values[propertyZ]);
+                        } else if (list.size() < 3) {
+                            chunk.errorLine = headerLines + line + 1;
+                            chunk.error = "a face needs at least three corners";
+                        } else if (pass == 0) {
+                            chunk.triangles += list.size() - 2;
+                        } else {
+                            corners.clear();
+                            for (size_t n = 0; n < list.size(); n++) {
+                                if (list[n] < 0 || list[n] >= (long long)vertexCount) {
+                                    chunk.errorLine = headerLines + line + 1;
+                                    chunk.error = "a face refers to a vertex that does not exist";
+                                    break;
+                                }
+                                corners.push_back((GLuint)list[n]);
+                            }
+                            if (chunk.errorLine == 0) {
+                                addPolygon(corners.data(), (GLuint)corners.size(), triangle);
+                                triangle += corners.size() - 2;
+                            }
+                        }
+                    }
+                }
+            });
+        }
+        return reportChunkErrors(fileName, chunks);
+    }
+
+    // Binary: the elements before the faces are skipped over to find where the vertices and faces
+    // start, record by record only if they have lists
+    const char* vertexStart = nullptr;
+    PlyElement beforeCorners; // the properties of a face before its corners
+    beforeCorners.properties.assign(faces.properties.begin(), faces.properties.begin() + propertyCorners);
+    std::vector<const char*> faceBlocks;
+    std::vector<size_t> blockTriangles;
+    for (size_t e = 0; e <= faceElement || e <= vertexElement; e++) {
+        const PlyElement& element = elements[e];
+        if (e == vertexElement)
+            vertexStart = p;
+        if (e == faceElement) {
+            faceBlocks.push_back(p);
+            blockTriangles.push_back(0);
+        }
+
+        size_t fixedSize = 0;
+        bool fixed = true;
+        for (size_t i = 0; i < element.properties.size(); i++) {
+            fixed = fixed && !element.properties[i].list;
+            fixedSize += plySize(element.properties[i].type);
+        }
+        if (fixed) {
+            if (element.count > (size_t)(end - p) / std::max(fixedSize, (size_t)1)) {
+                std::cerr << fileName << ": the PLY file ends before its last record" << std::endl;
+                return false;
+            }
+            p += element.count * fixedSize;
+            continue;
+        }
+        for (size_t r = 0; r < element.count; r++) {
+            if (e == faceElement) {
+                if (r > 0 && r % RECORD_BLOCK == 0) {
+                    faceBlocks.push_back(p);
+                    blockTriangles.push_back(0);
+                }
+                // The corners of the face, the properties before them are skipped
+                const char* q = p;
+                if (skipPlyRecord(q, end, beforeCorners, swapped)
+                    && (size_t)(end - q) >= plySize(element.properties[propertyCorners].countType)) {
+                    double corners = readPlyValue(q, element.properties[propertyCorners].countType, swapped);
+                    if (corners < 3.0) {
+                        std::cerr << fileName << ": face " << r << " needs at least three corners" << std::endl;
+                        return false;
+                    }
+                    blockTriangles.back() += (size_t)corners - 2;
+                }
+            }
+            if (!skipPlyRecord(p, end, element, swapped)) {
+                std::cerr << fileName << ": the PLY file ends before its last record" << std::endl;
+                return false;
+            }
+        }
+    }
+    faceBlocks.push_back(p);
+
+    size_t triangleCount = 0;
+    std::vector<size_t> blockFirstTriangle(blockTriangles.size());
+    for (size_t b = 0; b < blockTriangles.size(); b++) {
+        blockFirstTriangle[b] = triangleCount;
+        triangleCount += blockTriangles[b];
+    }
+    if (3 * triangleCount >= UINT32_MAX) {
+        std::cerr << fileName << ": the mesh is too large" << std::endl;
+        return false;
+    }
+    indices.resize(3 * triangleCount);
+    diagonals.resize(triangleCount);
+
+    // The vertices, in blocks of records of a fixed size unless the vertices have lists
+    bool fixedVertices = true;
+    size_t vertexSize = 0;
+    for (size_t i = 0; i < vertices.properties.size(); i++) {
+        fixedVertices = fixedVertices && !vertices.properties[i].list;
+        vertexSize += plySize(vertices.properties[i].type);
+    }
+    auto readVertex = [&](const char*& q, size_t v) {
+        double coordinates[3] = {0.0, 0.0, 0.0};
+        for (size_t i = 0; i < vertices.properties.size(); i++) {
+            const PlyProperty& property = vertices.properties[i];
+            size_t count = 1;
+            if (property.list) {
+                count = (size_t)readPlyValue(q, property.countType, swapped);
+                q += plySize(property.countType);
+            } else if (i == propertyX || i == propertyY || i == propertyZ) {
+                coordinates[i == propertyX ? 0 : i == propertyY ? 1 : 2] = readPlyValue(q, property.type, swapped);
+            }
+            q += count * plySize(property.type);
+        }
+        positions[v] = glm::vec3(coordinates[0], coordinates[1], coordinates[2]);
+    };
+    if (fixedVertices) {
+        pool.parallelFor((GLuint)((vertexCount + RECORD_BLOCK - 1) / RECORD_BLOCK), 1, [&](GLuint first, GLuint last) {
+            for (size_t v = first * RECORD_BLOCK; v < std::min((size_t)last * RECORD_BLOCK, vertexCount); v++) {
+                const char* q = vertexStart + v * vertexSize;
+                readVertex(q, v);
+            }
+        });
+    } else {
+        const char* q = vertexStart;
+        for (size_t v = 0; v < vertexCount; v++)
+            readVertex(q, v);
+    }
+
+    // The faces, in the blocks found above
+    std::vector<unsigned char> invalid(blockTriangles.size(), 0);
+    pool.parallelFor((GLuint)blockTriangles.size(), 1, [&](GLuint first, GLuint last) {
+        std::vector<GLuint> corners;
+        for (GLuint b = first; b < last; b++) {
+            const char* q = faceBlocks[b];
+            size_t triangle = blockFirstTriangle[b];
+            while (q < faceBlocks[b + 1] && !invalid[b]) {
+                for (size_t i = 0; i < faces.properties.size(); i++) {
+                    const PlyProperty& property = faces.properties[i];
+                    size_t count = 1;
+                    if (property.list) {
+                        count = (size_t)readPlyValue(q, property.countType, swapped);
+                        q += plySize(property.countType);
+                    }
+                    if (i == propertyCorners) {
+                        corners.clear();
+                        for (size_t n = 0; n < count; n++) {
+                            double index = readPlyValue(q + n * plySize(property.type), property.type, swapped);
+                            if (index < 0.0 || index >= (double)vertexCount)
+                                invalid[b] = 1;
+                            corners.push_back((GLuint)index);
+                        }
+                    }
+                    q += count * plySize(property.type);
+                }
+                if (!invalid[b]) {
+                    addPolygon(corners.data(), (GLuint)corners.size(), triangle);
+                    triangle += corners.size() - 2;
+                }
+            }
+        }
+    });
+    for (size_t b = 0; b < invalid.size(); b++) {
+        if (invalid[b]) {
+            std::cerr << fileName << ": a face refers to a vertex that does not exist" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Cuts a polygon into a fan of triangles around its first corner, written from triangle on
+void ClothMesh::addPolygon(const GLuint* corners, GLuint count, size_t triangle) {
+    for (GLuint i = 1; i + 1 < count; i++, triangle++) {
+        indices[3 * triangle] = corners[0];
+        indices[3 * triangle + 1] = corners[i];
+        indices[3 * triangle + 2] = corners[i + 1];
+        // Edge 0 runs from the first corner to corner i, edge 1 along the polygon and edge 2
+        // from corner i + 1 back to the first
+        diagonals[triangle] = (unsigned char)((i > 1 ? 1 : 0) | (i + 2 < count ? 4 : 0));
+    }
+}
+
+// Sorts items into one bucket per vertex by counting them first, bucket v is
+// [starts[v], starts[v + 1]) of the result
+template <typename T, typename Vertex>
+static std::vector<T> bucketByVertex(const std::vector<T>& items, GLuint vertexCount, Vertex vertexOf,
+                                     std::vector<size_t>& starts) {
+    starts.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < items.size(); i++)
+        starts[vertexOf(items[i]) + 1]++;
+    for (GLuint v = 0; v < vertexCount; v++)
+        starts[v + 1] += starts[v];
+    std::vector<size_t> filled(starts.begin(), starts.end() - 1);
+    std::vector<T> sorted(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+        sorted[filled[vertexOf(items[i])]++] = items[i];
+    return sorted;
+}
+
+// The springs of the mesh: every edge once, a structural spring or a shear spring on a diagonal,
+// and for every edge of exactly two triangles a spring between the corners across it, a shear
+// spring across a diagonal and a bend spring across any other edge. Springs across an edge that
+// another spring already joins are dropped.
+bool ClothMesh::findSprings(const std::string& fileName) {
+    GLuint vertexCount = (GLuint)positions.size();
+    size_t triangleCount = indices.size() / 3;
+
+    // Every edge of every triangle, with the corner across it
+    struct EdgeRecord {
+        GLuint lower, higher, across;
+        bool diagonal;
+    };
+    std::vector<EdgeRecord> records(3 * triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (GLuint c = 0; c < 3; c++) {
+            GLuint a = indices[3 * t + c], b = indices[3 * t + (c + 1) % 3];
+            if (a == b) {
+                std::cerr << fileName << ": triangle " << t << " has the same vertex twice" << std::endl;
+                return false;
+            }
+            EdgeRecord record = {std::min(a, b), std::max(a, b), indices[3 * t + (c + 2) % 3],
+                                 ((diagonals[t] >> c) & 1) != 0};
+            records[3 * t + c] = record;
+        }
+    }
+    std::vector<size_t> starts;
+    records = bucketByVertex(records, vertexCount, [](const EdgeRecord& record) { return record.lower; }, starts);
+
+    // The candidates, edges before the springs across them
+    struct Candidate {
+        Spring spring;
+        bool across;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(records.size());
+    for (GLuint v = 0; v < vertexCount; v++) {
+        std::sort(records.begin() + starts[v], records.begin() + starts[v + 1],
+                  [](const EdgeRecord& x, const EdgeRecord& y) {
+                      return x.higher < y.higher || (x.higher == y.higher && x.across < y.across);
+                  });
+        for (size_t first = starts[v], last; first < starts[v + 1]; first = last) {
+            for (last = first + 1; last < starts[v + 1] && records[last].higher == records[first].higher; last++) {}
+            const EdgeRecord& edge = records[first];
+            Candidate candidate = {{v, edge.higher, edge.diagonal ? SPRING_SHEAR : SPRING_STRUCTURAL}, false};
+            candidates.push_back(candidate);
+            if (last - first == 2 && records[first].across != records[first + 1].across) {
+                GLuint a = records[first].across, b = records[first + 1].across;
+                Candidate across = {{std::min(a, b), std::max(a, b), edge.diagonal ? SPRING_SHEAR : SPRING_BEND}, true};
+                candidates.push_back(across);
+            }
+        }
+    }
+
+    candidates = bucketByVertex(candidates, vertexCount, [](const Candidate& candidate) { return candidate.spring.a; },
+                                starts);
+    springs.reserve(candidates.size());
+    longestSpring = 0.0f;
+    for (GLuint v = 0; v < vertexCount; v++) {
+        std::sort(candidates.begin() + starts[v], candidates.begin() + starts[v + 1],
+                  [](const Candidate& x, const Candidate& y) {
+                      return x.spring.b < y.spring.b || (x.spring.b == y.spring.b && x.across < y.across)
+                             || (x.spring.b == y.spring.b && x.across == y.across && x.spring.type < y.spring.type);
+                  });
+        for (size_t c = starts[v]; c < starts[v + 1]; c++) {
+            const Spring& spring = candidates[c].spring;
+            if (c > starts[v] && candidates[c - 1].spring.b == spring.b)
+                continue;
+            GLfloat length = glm::length(positions[spring.b] - positions[spring.a]);
+            if (length <= 0.0f) {
+                std::cerr << fileName << ": vertices " << spring.a << " and " << spring.b
+                          << " are joined but lie on top of each other" << std::endl;
+                return false;
+            }
+            longestSpring = std::max(longestSpring, length);
+            springs.push_back(spring);
+        }
+    }
+    return true;
+}
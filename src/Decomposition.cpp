@@ -0,0 +1,381 @@
+#include "Decomposition.h"
+#include "World.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+// The processes share atomics through memory mapped at different addresses, which only works for
+// lock free atomics
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "shared atomics have to be lock free");
+
+static const size_t CACHE_LINE = 64;
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+// Waits until condition holds, false if abort is set first. Yields for a while and then sleeps,
+// so waiting processes leave the CPUs to the ones still simulating.
+template <typename Condition>
+static bool waitUntil(Condition condition, const std::atomic<uint32_t>& abort) {
+    for (GLuint spins = 0; !condition(); spins++) {
+        if (abort.load(std::memory_order_acquire))
+            return false;
+        if (spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+    return true;
+}
+
+/*******************************************
+ *************** SharedRing ****************
+ *******************************************/
+
+size_t SharedRing::getSize(GLuint slotCount, size_t messageBytes) {
+    return alignUp(sizeof(Header)) + slotCount * alignUp(messageBytes);
+}
+
+void SharedRing::create(void* memory, GLuint slotCount, size_t messageBytes) {
+    Header* header = new (memory) Header;
+    header->head.store(0);
+    header->tail.store(0);
+    header->slotCount = slotCount;
+    header->messageBytes = messageBytes;
+}
+
+SharedRing::SharedRing(void* memory) {
+    header = static_cast<Header*>(memory);
+    slots = static_cast<unsigned char*>(memory) + alignUp(sizeof(Header));
+}
+
+void* SharedRing::beginPush(const std::atomic<uint32_t>& abort) {
+    uint64_t head = header->head.load(std::memory_order_relaxed);
+    Header* ring = header;
+    if (!waitUntil([ring, head] { return head - ring->tail.load(std::memory_order_acquire) < ring->slotCount; },
+                   abort))
+        return nullptr;
+    return slots + (head % header->slotCount) * alignUp(header->messageBytes);
+}
+
+void SharedRing::push() {
+    header->head.store(header->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const void* SharedRing::beginPop(const std::atomic<uint32_t>& abort) {
+    uint64_t tail = header->tail.load(std::memory_order_relaxed);
+    Header* ring = header;
+    if (!waitUntil([ring, tail] { return ring->head.load(std::memory_order_acquire) > tail; }, abort))
+        return nullptr;
+    return slots + (tail % header->slotCount) * alignUp(header->messageBytes);
+}
+
+void SharedRing::pop() {
+    header->tail.store(header->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/*******************************************
+ ************* Decomposition ***************
+ *******************************************/
+
+Decomposition::Decomposition(const Scene& theScene, GLuint theProcessCount) {
+    scene = theScene;
+    processCount = theProcessCount;
+    width = scene.cloths.empty() ? 0 : scene.cloths[0].width;
+    height = scene.cloths.empty() ? 0 : scene.cloths[0].height;
+    frame = 0;
+    memory = nullptr;
+    memoryBytes = 0;
+    control = nullptr;
+    framesDone = nullptr;
+    states = nullptr;
+}
+
+Decomposition::~Decomposition() {
+    stop();
+#ifndef _WIN32
+    if (memory)
+        munmap(memory, memoryBytes);
+#endif
+}
+
+// First row of a band, band processCount gives the end of the last band
+GLuint Decomposition::getFirstRow(GLuint band) {
+    return (GLuint)((uint64_t)height * band / processCount);
+}
+
+void* Decomposition::getRing(GLuint ring) {
+    return static_cast<unsigned char*>(memory) + ringOffsets[ring];
+}
+
+GLuint Decomposition::getProcessCount() {
+    return processCount;
+}
+
+GLuint Decomposition::getParticleCount() {
+    return width * height;
+}
+
+const GLfloat* Decomposition::getStates() {
+    return states;
+}
+
+uint64_t Decomposition::getStateHash() {
+    return World::hashStates(states, width * height, World::FNV_OFFSET);
+}
+
+#ifdef _WIN32
+
+bool Decomposition::canSplit() {
+    std::cerr << "Simulating in several processes needs POSIX shared memory" << std::endl;
+    return false;
+}
+
+bool Decomposition::start() {
+    return canSplit();
+}
+
+bool Decomposition::step() {
+    return false;
+}
+
+void Decomposition::stop() {}
+
+#else
+
+bool Decomposition::canSplit() {
+    if (scene.cloths.size() != 1 || scene.cloths[0].copiesX * scene.cloths[0].copiesZ != 1) {
+        std::cerr << "Only a scene with a single cloth can be split over processes" << std::endl;
+        return false;
+    }
+    if (scene.cloths[0].mesh) {
+        std::cerr << "A mesh has no rows, it cannot be split over processes" << std::endl;
+        return false;
+    }
+    if (scene.canTear()) {
+        std::cerr << "A tearing cloth cannot be split over processes" << std::endl;
+        return false;
+    }
+    if (scene.solver.method != SOLVER_EXPLICIT) {
+        std::cerr << "The implicit and projective solvers couple the whole cloth, it cannot be split over processes"
+                  << std::endl;
+        return false;
+    }
+    if (scene.solver.adaptive) {
+        std::cerr << "The bands would choose different steps, adaptive steps cannot be split over processes"
+                  << std::endl;
+        return false;
+    }
+    if (scene.solver.tethers) {
+        std::cerr << "Tethers reach across the whole cloth, it cannot be split over processes" << std::endl;
+        return false;
+    }
+    if (scene.solver.precision != PRECISION_FLOAT) {
+        std::cerr << "The bands trade their rows as float states, only float scenes can be split over processes"
+                  << std::endl;
+        return false;
+    }
+    if (processCount == 0 || height / processCount < GHOST_ROWS) {
+        std::cerr << "A cloth of " << height << " rows cannot be split into " << processCount
+                  << " bands of at least " << GHOST_ROWS << " rows" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Decomposition::start() {
+    if (!canSplit())
+        return false;
+
+    // Control block, frames done per worker, the rings and the states of the whole cloth
+    size_t messageBytes = (size_t)GHOST_ROWS * width * 6 * sizeof(GLfloat);
+    memoryBytes = alignUp(sizeof(Control)) + alignUp(processCount * sizeof(std::atomic<uint32_t>));
+    ringOffsets.clear();
+    for (GLuint r = 0; r + 2 < 2 * processCount; r++) {
+        ringOffsets.push_back(memoryBytes);
+        memoryBytes += SharedRing::getSize(RING_SLOTS, messageBytes);
+    }
+    size_t statesOffset = memoryBytes;
+    memoryBytes += (size_t)width * height * 6 * sizeof(GLfloat);
+
+    std::string name = "/tygladig-" + std::to_string((long)getpid());
+    int file = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (file < 0) {
+        std::cerr << "Could not create shared memory " << name << std::endl;
+        return false;
+    }
+    shm_unlink(name.c_str());
+    if (ftruncate(file, (off_t)memoryBytes) != 0) {
+        std::cerr << "Could not size shared memory of " << memoryBytes << " bytes" << std::endl;
+        close(file);
+        return false;
+    }
+    memory = mmap(nullptr, memoryBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    close(file);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Could not map shared memory of " << memoryBytes << " bytes" << std::endl;
+        memory = nullptr;
+        return false;
+    }
+
+    unsigned char* bytes = static_cast<unsigned char*>(memory);
+    control = new (bytes) Control;
+    control->frames.store(0);
+    control->stopping.store(0);
+    framesDone = reinterpret_cast<std::atomic<uint32_t>*>(bytes + alignUp(sizeof(Control)));
+    for (GLuint b = 0; b < processCount; b++)
+        new (&framesDone[b]) std::atomic<uint32_t>(0);
+    for (GLuint r = 0; r < ringOffsets.size(); r++)
+        SharedRing::create(getRing(r), RING_SLOTS, messageBytes);
+    states = reinterpret_cast<GLfloat*>(bytes + statesOffset);
+
+    // Buffered output would otherwise be written again by every worker
+    std::cout.flush();
+    std::cerr.flush();
+    for (GLuint b = 0; b < processCount; b++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int code = 0;
+            try {
+                runWorker(b);
+            } catch (const std::bad_alloc&) {
+                code = 1;
+            }
+            _exit(code);
+        }
+        if (pid < 0) {
+            std::cerr << "Could not start the process of band " << b << std::endl;
+            stop();
+            return false;
+        }
+        workers.push_back(pid);
+    }
+    return true;
+}
+
+// The loop of a worker process: simulates its band frame by frame as the coordinator allows,
+// trading the outermost rows with the neighbours after every substep
+void Decomposition::runWorker(GLuint band) {
+    GLuint first = getFirstRow(band), last = getFirstRow(band + 1);
+    GLuint bandFirst = band > 0 ? first - GHOST_ROWS : first;
+    GLuint bandLast = band + 1 < processCount ? last + GHOST_ROWS : last;
+    std::unique_ptr<World> world = World::create(scene, bandFirst, bandLast - bandFirst);
+
+    GLuint ghostCount = GHOST_ROWS * width;
+    GLuint ownFirst = (first - bandFirst) * width, ownCount = (last - first) * width;
+    bool up = band > 0, down = band + 1 < processCount;
+    SharedRing sendUp(up ? getRing(2 * (band - 1) + 1) : memory), fromUp(up ? getRing(2 * (band - 1)) : memory);
+    SharedRing sendDown(down ? getRing(2 * band) : memory), fromDown(down ? getRing(2 * band + 1) : memory);
+
+    const std::atomic<uint32_t>& stopping = control->stopping;
+    GLuint done = 0;
+    while (true) {
+        Control* shared = control;
+        if (!waitUntil([shared, done] { return shared->frames.load(std::memory_order_acquire) > done; }, stopping))
+            return;
+
+        // Bands never tear, so the substeps need no reset of the step's scratch
+        for (GLuint s = 0; s < scene.solver.substeps; s++) {
+            world->substep(false);
+
+            void* message;
+            if (up) {
+                if (!(message = sendUp.beginPush(stopping)))
+                    return;
+                world->getStates(ownFirst, ghostCount, static_cast<GLfloat*>(message));
+                sendUp.push();
+            }
+            if (down) {
+                if (!(message = sendDown.beginPush(stopping)))
+                    return;
+                world->getStates(ownFirst + ownCount - ghostCount, ghostCount, static_cast<GLfloat*>(message));
+                sendDown.push();
+            }
+
+            const void* received;
+            if (up) {
+                if (!(received = fromUp.beginPop(stopping)))
+                    return;
+                world->setStates(0, ghostCount, static_cast<const GLfloat*>(received));
+                fromUp.pop();
+            }
+            if (down) {
+                if (!(received = fromDown.beginPop(stopping)))
+                    return;
+                world->setStates(ownFirst + ownCount, ghostCount, static_cast<const GLfloat*>(received));
+                fromDown.pop();
+            }
+        }
+
+        world->getStates(ownFirst, ownCount, states + (size_t)first * width * 6);
+        framesDone[band].store(++done, std::memory_order_release);
+    }
+}
+
+bool Decomposition::step() {
+    if (!control || control->stopping.load())
+        return false;
+
+    frame++;
+    control->frames.store(frame, std::memory_order_release);
+
+    // The step barrier: every band has written its rows of the frame
+    for (GLuint spins = 0; ; spins++) {
+        bool finished = true;
+        for (GLuint b = 0; b < processCount && finished; b++)
+            finished = framesDone[b].load(std::memory_order_acquire) >= frame;
+        if (finished)
+            return true;
+        if (!checkWorkers()) {
+            stop();
+            return false;
+        }
+        if (spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+// Reports workers that have exited, false if there are any
+bool Decomposition::checkWorkers() {
+    bool running = true;
+    for (GLuint b = 0; b < workers.size(); b++) {
+        int status;
+        if (workers[b] == 0 || waitpid(workers[b], &status, WNOHANG) != workers[b])
+            continue;
+        workers[b] = 0;
+        running = false;
+
+        std::cerr << "The process of rows " << getFirstRow(b) << " to " << getFirstRow(b + 1) - 1;
+        if (WIFSIGNALED(status))
+            std::cerr << " was killed by signal " << WTERMSIG(status) << std::endl;
+        else
+            std::cerr << " exited with code " << WEXITSTATUS(status) << std::endl;
+    }
+    return running;
+}
+
+void Decomposition::stop() {
+    if (control)
+        control->stopping.store(1, std::memory_order_release);
+    for (GLuint b = 0; b < workers.size(); b++) {
+        if (workers[b] != 0)
+            waitpid(workers[b], nullptr, 0);
+    }
+    workers.clear();
+}
+
+#endif //_WIN32
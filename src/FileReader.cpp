@@ -2,6 +2,13 @@
 
 #include <iostream>
 #include <fstream>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 const std::string FileReader::ReadFromFile(std::string fileName) {
     std::ifstream ifs(fileName.c_str());
@@ -18,4 +25,17 @@ const std::string FileReader::ReadFromFile(std::string fileName) {
 
     ifs.close();
     return out;
+}
+
+bool FileReader::MakeDirectory(std::string directory) {
+#ifdef _WIN32
+    int result = _mkdir(directory.c_str());
+#else
+    int result = mkdir(directory.c_str(), 0755);
+#endif
+    if (result != 0 && errno != EEXIST) {
+        std::cerr << "Could not create directory " << directory << std::endl;
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,287 @@
+#include "FrameCache.h"
+#include "FrameCodec.h"
+#include "FileReader.hpp"
+#include "Profiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+// Builds the file name of a chunk inside a cache directory
+static std::string chunkPath(std::string directory, GLuint chunk) {
+    std::ostringstream name;
+    name << directory << "/chunk_" << std::setw(5) << std::setfill('0') << chunk << ".bin";
+    return name.str();
+}
+
+static std::string infoPath(std::string directory) {
+    return directory + "/cache.info";
+}
+
+/*******************************************
+ ************ FrameCacheWriter *************
+ *******************************************/
+
+FrameCacheWriter::FrameCacheWriter(std::string theDirectory, GLuint theParticleCount, GLfloat theErrorBound,
+                                   GLuint theFramesPerChunk) {
+    directory = theDirectory;
+    particleCount = theParticleCount;
+    errorBound = theErrorBound;
+    framesPerChunk = theFramesPerChunk > 0 ? theFramesPerChunk : 1;
+    frameCount = 0;
+    stopping = false;
+    writeFailed = false;
+    bufferCount = 0;
+    stalls = 0;
+    open = FileReader::MakeDirectory(directory);
+
+    if (open) {
+        // Two spare buffers are enough for the writer to keep up with the simulation
+        for (int i = 0; i < 2; i++) {
+            freeBuffers.push_back(std::vector<GLfloat>(3 * particleCount * framesPerChunk));
+        }
+        bufferCount = 2;
+        startChunk(0);
+        writer = std::thread(&FrameCacheWriter::writerLoop, this);
+    }
+}
+
+FrameCacheWriter::~FrameCacheWriter() {
+    close();
+}
+
+void FrameCacheWriter::append(const GLfloat* positions) {
+    if (!open)
+        return;
+
+    std::memcpy(&current.positions[3 * particleCount * current.frameCount], positions,
+                3 * particleCount * sizeof(GLfloat));
+    current.frameCount++;
+    frameCount++;
+
+    if (current.frameCount == framesPerChunk) {
+        submitChunk();
+        startChunk(current.index + 1);
+    }
+}
+
+void FrameCacheWriter::close() {
+    if (!open)
+        return;
+
+    if (current.frameCount > 0)
+        submitChunk();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueChanged.notify_one();
+    writer.join();
+
+    if (!writeInfo())
+        writeFailed = true;
+    if (writeFailed)
+        std::cerr << "Frame cache " << directory << " is incomplete" << std::endl;
+    else
+        std::cout << "Wrote " << frameCount << " frames to " << directory << std::endl;
+    if (stalls > 0)
+        std::cout << "Writing the frame cache held up the simulation " << stalls << " times, with every "
+                  << "chunk buffer waiting for the disk" << std::endl;
+
+    open = false;
+}
+
+bool FrameCacheWriter::isOpen() {
+    return open;
+}
+
+GLuint FrameCacheWriter::getFrameCount() {
+    return frameCount;
+}
+
+void FrameCacheWriter::startChunk(GLuint index) {
+    current.index = index;
+    current.frameCount = 0;
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    if (freeBuffers.empty() && bufferCount < MAX_BUFFERS) {
+        // The writer is behind, keep simulating into a new buffer instead of waiting for it
+        current.positions.assign(3 * particleCount * framesPerChunk, 0.0f);
+        bufferCount++;
+        return;
+    }
+    if (freeBuffers.empty()) {
+        // It is so far behind that every buffer is taken, wait rather than drop frames from the cache
+        stalls++;
+        bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+    }
+    current.positions.swap(freeBuffers.back());
+    freeBuffers.pop_back();
+}
+
+void FrameCacheWriter::submitChunk() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.push_back(Chunk());
+        pending.back().index = current.index;
+        pending.back().frameCount = current.frameCount;
+        pending.back().positions.swap(current.positions);
+    }
+    queueChanged.notify_one();
+}
+
+void FrameCacheWriter::writerLoop() {
+    PROFILE_THREAD_NAME("cache writer");
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true) {
+        queueChanged.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty())
+            return;
+
+        Chunk chunk;
+        chunk.index = pending.front().index;
+        chunk.frameCount = pending.front().frameCount;
+        chunk.positions.swap(pending.front().positions);
+        pending.pop_front();
+
+        // Write without holding the lock so the simulation can keep submitting
+        lock.unlock();
+        bool written = writeChunk(chunk);
+        lock.lock();
+
+        if (!written)
+            writeFailed = true;
+        freeBuffers.push_back(std::vector<GLfloat>());
+        freeBuffers.back().swap(chunk.positions);
+        bufferFreed.notify_one();
+    }
+}
+
+bool FrameCacheWriter::writeChunk(const Chunk& chunk) {
+    PROFILE_SCOPE(PHASE_CACHE);
+    std::ofstream file(chunkPath(directory, chunk.index).c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << chunkPath(directory, chunk.index) << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> encoded;
+    FrameCodec::encode(chunk.positions.data(), particleCount, chunk.frameCount, errorBound, encoded);
+    file.write((const char*)encoded.data(), encoded.size());
+    return file.good();
+}
+
+bool FrameCacheWriter::writeInfo() {
+    std::ofstream file(infoPath(directory).c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << infoPath(directory) << std::endl;
+        return false;
+    }
+    file << "particles " << particleCount << std::endl
+         << "framesPerChunk " << framesPerChunk << std::endl
+         << "errorBound " << errorBound << std::endl
+         << "frames " << frameCount << std::endl;
+    return file.good();
+}
+
+/*******************************************
+ ************ FrameCacheReader *************
+ *******************************************/
+
+FrameCacheReader::FrameCacheReader(std::string theDirectory) {
+    directory = theDirectory;
+    particleCount = 0;
+    framesPerChunk = 0;
+    frameCount = 0;
+    loadedChunk = -1;
+    prefetchedChunk = -1;
+    open = false;
+
+    std::ifstream file(infoPath(directory).c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open frame cache " << directory << std::endl;
+        return;
+    }
+
+    std::string key;
+    double value;
+    while (file >> key >> value) {
+        if (key == "particles")
+            particleCount = (GLuint)value;
+        else if (key == "framesPerChunk")
+            framesPerChunk = (GLuint)value;
+        else if (key == "frames")
+            frameCount = (GLuint)value;
+    }
+    open = particleCount > 0 && framesPerChunk > 0;
+    if (!open)
+        std::cerr << "Invalid frame cache header in " << directory << std::endl;
+}
+
+FrameCacheReader::~FrameCacheReader() {
+    if (prefetch.valid())
+        prefetch.wait();
+}
+
+bool FrameCacheReader::isOpen() {
+    return open;
+}
+
+GLuint FrameCacheReader::getParticleCount() {
+    return particleCount;
+}
+
+GLuint FrameCacheReader::getFrameCount() {
+    return frameCount;
+}
+
+const GLfloat* FrameCacheReader::getFrame(GLuint frame) {
+    if (!open || frame >= frameCount)
+        return nullptr;
+
+    GLint chunk = frame / framesPerChunk;
+    if (chunk != loadedChunk) {
+        if (chunk == prefetchedChunk && prefetch.valid())
+            chunkPositions = prefetch.get();
+        else
+            chunkPositions = readChunk(chunk);
+        loadedChunk = chunk;
+
+        // Playback usually moves forward, so start reading the next chunk right away
+        if (prefetch.valid())
+            prefetch.wait();
+        prefetchedChunk = -1;
+        if ((GLuint)(chunk + 1) * framesPerChunk < frameCount) {
+            prefetchedChunk = chunk + 1;
+            prefetch = std::async(std::launch::async, &FrameCacheReader::readChunk, this, (GLuint)prefetchedChunk);
+        }
+    }
+
+    GLuint first = 3 * particleCount * (frame % framesPerChunk);
+    if (first + 3 * particleCount > chunkPositions.size())
+        return nullptr;
+    return &chunkPositions[first];
+}
+
+std::vector<GLfloat> FrameCacheReader::readChunk(GLuint chunk) {
+    std::vector<GLfloat> positions;
+    std::ifstream file(chunkPath(directory, chunk).c_str(), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << chunkPath(directory, chunk) << std::endl;
+        return positions;
+    }
+
+    std::vector<unsigned char> encoded((size_t)file.tellg());
+    file.seekg(0);
+    file.read((char*)encoded.data(), encoded.size());
+    if (!file.good()
+        || !FrameCodec::decode(encoded.data(), encoded.size(), particleCount, framesPerChunk, positions)) {
+        std::cerr << "Could not decode " << chunkPath(directory, chunk) << std::endl;
+        positions.clear();
+    }
+    return positions;
+}
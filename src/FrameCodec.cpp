@@ -0,0 +1,342 @@
+#include "FrameCodec.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Chunk layout:
+//   uint8   mode (RawChunk or QuantisedChunk)
+//   uint32  frame count
+// Raw chunks are followed by the float positions. Quantised chunks are followed by
+//   float   bounding box minimum x, y, z
+//   float   quantisation step
+//   uint32  size of the Rice coded stream in bytes, then the stream itself
+enum ChunkMode {
+    RawChunk = 0,
+    QuantisedChunk = 1
+};
+
+// Number of values sharing one Rice parameter
+const size_t RICE_BLOCK = 64;
+// Quotients this large are escaped and written as a raw 32 bit value
+const uint32_t RICE_ESCAPE = 24;
+
+// Largest quantised coordinate, integers up to this size convert to GLfloat without rounding
+const double MAX_QUANTISED = 1 << 24;
+
+/*******************************************
+ ************* Bit stream I/O **************
+ *******************************************/
+
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    uint64_t buffer;
+    int bits;
+
+    BitWriter(std::vector<unsigned char>& theOut) : out(theOut), buffer(0), bits(0) {}
+
+    // Writes the count (at most 32) lowest bits of value
+    void write(uint32_t value, int count) {
+        if (count < 32)
+            value &= (1u << count) - 1;
+        buffer |= (uint64_t)value << bits;
+        bits += count;
+        while (bits >= 8) {
+            out.push_back((unsigned char)buffer);
+            buffer >>= 8;
+            bits -= 8;
+        }
+    }
+
+    void flush() {
+        if (bits > 0)
+            out.push_back((unsigned char)buffer);
+        buffer = 0;
+        bits = 0;
+    }
+};
+
+struct BitReader {
+    const unsigned char* data;
+    size_t size;
+    size_t next;
+    uint64_t buffer;
+    size_t bits;
+
+    BitReader(const unsigned char* theData, size_t theSize) : data(theData), size(theSize), next(0), buffer(0), bits(0) {}
+
+    // Reads count (at most 32) bits, returns false when the stream runs out
+    bool read(size_t count, uint32_t& value) {
+        while (bits < count) {
+            if (next == size)
+                return false;
+            buffer |= (uint64_t)data[next++] << bits;
+            bits += 8;
+        }
+        value = count < 32 ? (uint32_t)(buffer & ((1ull << count) - 1)) : (uint32_t)buffer;
+        buffer >>= count;
+        bits -= count;
+        return true;
+    }
+
+    // Tops the window up to at least 57 bits, or to the end of the stream. Away from the end eight
+    // bytes are loaded at once, little endian like the rest of the chunk, and the whole ones among
+    // them consumed, the bits of the partial byte above the window are the same as the next load
+    // puts there.
+    void refill() {
+        if (size - next >= 8) {
+            uint64_t word;
+            std::memcpy(&word, data + next, 8);
+            buffer |= word << bits;
+            next += (63 - bits) >> 3;
+            bits |= 56;
+        } else {
+            while (bits <= 56 && next < size) {
+                buffer |= (uint64_t)data[next++] << bits;
+                bits += 8;
+            }
+        }
+    }
+
+    // Drops count bits of the window, returns false if the stream had fewer
+    bool skip(size_t count) {
+        if (count > bits)
+            return false;
+        buffer >>= count;
+        bits -= count;
+        return true;
+    }
+};
+
+// Number of ones below the lowest zero of value, which must have a zero
+static inline uint32_t countTrailingOnes(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, ~value);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctzll(~value);
+#endif
+}
+
+template <typename T>
+static void put(std::vector<unsigned char>& out, T value) {
+    size_t at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(&out[at], &value, sizeof(T));
+}
+
+template <typename T>
+static bool get(const unsigned char* data, size_t size, size_t& at, T& value) {
+    if (at + sizeof(T) > size)
+        return false;
+    std::memcpy(&value, data + at, sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+/*******************************************
+ *************** Frame codec ***************
+ *******************************************/
+
+void FrameCodec::encode(const GLfloat* positions, GLuint particleCount, GLuint frameCount,
+                        GLfloat errorBound, std::vector<unsigned char>& out) {
+    out.clear();
+    size_t frameSize = 3 * (size_t)particleCount;
+
+    // Bounding box of the whole chunk
+    GLfloat boxMin[3] = {INFINITY, INFINITY, INFINITY};
+    GLfloat boxMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = 0; i < frameSize * frameCount; i++) {
+        boxMin[i % 3] = std::fmin(boxMin[i % 3], positions[i]);
+        boxMax[i % 3] = std::fmax(boxMax[i % 3], positions[i]);
+    }
+
+    // Rounding to the nearest grid point is off by at most half a step, the small margin covers
+    // the float rounding when the position is reconstructed. Far from the origin that rounding
+    // grows with the spacing of the floats, so the step shrinks to leave room for it, and chunks
+    // where nothing is left are stored raw.
+    GLfloat spacing = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        GLfloat largest = std::fmax(std::fabs(boxMin[a]), std::fabs(boxMax[a]));
+        spacing = std::fmax(spacing, std::nextafter(largest, INFINITY) - largest);
+    }
+    GLfloat step = std::fmin(1.9f * errorBound, 2.0f * (errorBound - 2.0f * spacing));
+    bool quantise = errorBound > 0.0f && frameCount > 0 && step > 0.0f;
+    for (int a = 0; a < 3 && quantise; a++) {
+        quantise = std::isfinite(boxMin[a]) && std::isfinite(boxMax[a])
+                   && (boxMax[a] - boxMin[a]) / step < MAX_QUANTISED;
+    }
+
+    // Quantise each frame into axis planes and store the zigzag coded delta to the previous frame.
+    // Every position is reconstructed as decode does and checked against the bound, so no chunk
+    // is stored with a larger error whatever the rounding.
+    std::vector<uint32_t> deltas;
+    if (quantise) {
+        std::vector<int32_t> previous(frameSize, 0), quantised(frameSize);
+        deltas.resize(frameSize * frameCount);
+        for (GLuint f = 0; f < frameCount && quantise; f++) {
+            const GLfloat* frame = positions + f * frameSize;
+            for (int a = 0; a < 3; a++) {
+                int32_t* plane = &quantised[a * particleCount];
+                for (GLuint p = 0; p < particleCount; p++) {
+                    plane[p] = (int32_t)std::lround((frame[3 * p + a] - boxMin[a]) / step);
+                    GLfloat decoded = boxMin[a] + (GLfloat)plane[p] * step;
+                    if (std::fabs((double)decoded - (double)frame[3 * p + a]) > errorBound)
+                        quantise = false;
+                }
+            }
+
+            uint32_t* frameDeltas = &deltas[f * frameSize];
+            for (size_t i = 0; i < frameSize; i++) {
+                int32_t delta = quantised[i] - previous[i];
+                frameDeltas[i] = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+            }
+            previous.swap(quantised);
+        }
+    }
+
+    if (!quantise) {
+        put<uint8_t>(out, RawChunk);
+        put<uint32_t>(out, frameCount);
+        size_t at = out.size();
+        out.resize(at + frameSize * frameCount * sizeof(GLfloat));
+        std::memcpy(&out[at], positions, frameSize * frameCount * sizeof(GLfloat));
+        return;
+    }
+
+    put<uint8_t>(out, QuantisedChunk);
+    put<uint32_t>(out, frameCount);
+    for (int a = 0; a < 3; a++)
+        put<GLfloat>(out, boxMin[a]);
+    put<GLfloat>(out, step);
+
+    std::vector<unsigned char> stream;
+    encodeRice(deltas.data(), deltas.size(), stream);
+    put<uint32_t>(out, (uint32_t)stream.size());
+    out.insert(out.end(), stream.begin(), stream.end());
+}
+
+bool FrameCodec::decode(const unsigned char* data, size_t size, GLuint particleCount, GLuint maxFrames,
+                        std::vector<GLfloat>& positions) {
+    size_t at = 0;
+    uint8_t mode;
+    uint32_t frameCount;
+    if (!get(data, size, at, mode) || !get(data, size, at, frameCount) || frameCount > maxFrames)
+        return false;
+
+    // Nothing is allocated before the header is known to fit the data, a corrupt chunk fails
+    // instead of asking for more memory than there is
+    size_t frameSize = 3 * (size_t)particleCount;
+    if (mode == RawChunk) {
+        if (frameCount > 0 && frameSize > (size - at) / sizeof(GLfloat) / frameCount)
+            return false;
+        positions.resize(frameSize * frameCount);
+        std::memcpy(positions.data(), data + at, positions.size() * sizeof(GLfloat));
+        return true;
+    }
+    if (mode != QuantisedChunk)
+        return false;
+
+    GLfloat boxMin[3], step;
+    uint32_t streamSize;
+    for (int a = 0; a < 3; a++) {
+        if (!get(data, size, at, boxMin[a]))
+            return false;
+    }
+    if (!get(data, size, at, step) || !get(data, size, at, streamSize) || streamSize > size - at)
+        return false;
+    // Every value takes at least one bit of the stream
+    if (frameCount > 0 && frameSize > (size_t)streamSize * 8 / frameCount)
+        return false;
+    positions.resize(frameSize * frameCount);
+
+    std::vector<uint32_t> deltas(frameSize * frameCount);
+    if (!decodeRice(data + at, streamSize, deltas.data(), deltas.size()))
+        return false;
+
+    // Everything below is plain loops over contiguous arrays that the compiler can vectorise
+    std::vector<int32_t> quantised(frameSize, 0);
+    std::vector<GLfloat> plane(particleCount);
+    for (GLuint f = 0; f < frameCount; f++) {
+        const uint32_t* frameDeltas = &deltas[f * frameSize];
+        int32_t* q = quantised.data();
+        for (size_t i = 0; i < frameSize; i++)
+            q[i] += (int32_t)(frameDeltas[i] >> 1) ^ -(int32_t)(frameDeltas[i] & 1);
+
+        GLfloat* frame = &positions[f * frameSize];
+        for (int a = 0; a < 3; a++) {
+            const int32_t* axis = q + a * particleCount;
+            GLfloat origin = boxMin[a];
+            GLfloat* values = plane.data();
+            for (GLuint p = 0; p < particleCount; p++)
+                values[p] = origin + (GLfloat)axis[p] * step;
+            for (GLuint p = 0; p < particleCount; p++)
+                frame[3 * p + a] = values[p];
+        }
+    }
+    return true;
+}
+
+void FrameCodec::encodeRice(const uint32_t* values, size_t count, std::vector<unsigned char>& out) {
+    BitWriter writer(out);
+
+    for (size_t block = 0; block < count; block += RICE_BLOCK) {
+        size_t end = block + RICE_BLOCK < count ? block + RICE_BLOCK : count;
+
+        // The Rice parameter is picked from the mean of the block
+        uint64_t sum = 0;
+        for (size_t i = block; i < end; i++)
+            sum += values[i];
+        uint64_t mean = sum / (end - block);
+        uint32_t k = 0;
+        while (k < 31 && (2ull << k) <= mean)
+            k++;
+        writer.write(k, 5);
+
+        for (size_t i = block; i < end; i++) {
+            uint32_t quotient = values[i] >> k;
+            if (quotient < RICE_ESCAPE) {
+                writer.write((1u << quotient) - 1, quotient + 1);
+                writer.write(values[i], k);
+            } else {
+                writer.write((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+                writer.write(values[i], 32);
+            }
+        }
+    }
+    writer.flush();
+}
+
+bool FrameCodec::decodeRice(const unsigned char* data, size_t size, uint32_t* values, size_t count) {
+    BitReader reader(data, size);
+
+    for (size_t block = 0; block < count; block += RICE_BLOCK) {
+        size_t end = block + RICE_BLOCK < count ? block + RICE_BLOCK : count;
+
+        uint32_t k;
+        if (!reader.read(5, k))
+            return false;
+
+        // A code is at most RICE_ESCAPE + 32 bits, so one refill holds all of it. The quotient is the
+        // run of ones at the bottom of the window, capped at the escape, and the remainder the k
+        // bits above its terminating zero.
+        for (size_t i = block; i < end; i++) {
+            reader.refill();
+            uint32_t quotient = countTrailingOnes(reader.buffer & ((1ull << RICE_ESCAPE) - 1));
+            if (quotient == RICE_ESCAPE) {
+                if (!reader.skip(RICE_ESCAPE) || !reader.read(32, values[i]))
+                    return false;
+            } else {
+                uint32_t remainder = (uint32_t)(reader.buffer >> (quotient + 1)) & (uint32_t)((1ull << k) - 1);
+                if (!reader.skip(quotient + 1 + k))
+                    return false;
+                values[i] = (quotient << k) | remainder;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#include "GpuProfiler.h"
+
+#ifdef TYGLADIG_PROFILING
+
+GpuProfiler::GpuProfiler() : current(0) {
+    glGenQueries(2 * LATENCY, &queries[0][0]);
+    for (GLuint i = 0; i < LATENCY; i++)
+        pending[i] = false;
+
+    // The GPU clock has its own origin, line it up with the profiler clock once
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    offset = (int64_t)Profiler::now() - (int64_t)gpuNow;
+    buffer = &Profiler::createBuffer("gpu");
+}
+
+GpuProfiler::~GpuProfiler() {
+    glDeleteQueries(2 * LATENCY, &queries[0][0]);
+}
+
+void GpuProfiler::begin() {
+    // Drop the oldest span if its results still have not arrived rather than waiting for them
+    pending[current] = false;
+    frames[current] = Profiler::getFrame();
+    glQueryCounter(queries[current][0], GL_TIMESTAMP);
+}
+
+void GpuProfiler::end() {
+    glQueryCounter(queries[current][1], GL_TIMESTAMP);
+    pending[current] = true;
+    current = (current + 1) % LATENCY;
+}
+
+void GpuProfiler::collect() {
+    // Oldest first so the samples stay in time order
+    for (GLuint i = 0; i < LATENCY; i++) {
+        GLuint slot = (current + i) % LATENCY;
+        if (!pending[slot])
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+        pending[slot] = false;
+
+        int64_t startTime = (int64_t)start + offset;
+        if (startTime < 0 || end < start)
+            continue;
+        buffer->record(PHASE_GPU, (uint64_t)startTime, (uint64_t)startTime + (end - start), frames[slot]);
+    }
+}
+
+#else
+
+GpuProfiler::GpuProfiler() {}
+GpuProfiler::~GpuProfiler() {}
+void GpuProfiler::begin() {}
+void GpuProfiler::end() {}
+void GpuProfiler::collect() {}
+
+#endif //TYGLADIG_PROFILING
@@ -0,0 +1,194 @@
+#include "MeshExporter.h"
+#include "FileReader.hpp"
+#include "Profiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+
+MeshExporter::MeshExporter(std::string theDirectory, MeshFormat theFormat, std::vector<GLuint> theIndices,
+                           GLuint theParticleCount, GLuint workerCount, GLuint queueCapacity) {
+    directory = theDirectory;
+    format = theFormat;
+    indices = theIndices;
+    particleCount = theParticleCount;
+    stopping = false;
+    skippedFrames = 0;
+    failures = 0;
+    open = FileReader::MakeDirectory(directory);
+
+    if (open) {
+        if (workerCount == 0)
+            workerCount = 1;
+
+        // Every queued or in-flight frame owns one buffer, all of them allocated once up front
+        for (GLuint i = 0; i < queueCapacity + workerCount; i++)
+            freeBuffers.push_back(std::vector<GLfloat>(3 * particleCount));
+        for (GLuint i = 0; i < workerCount; i++)
+            workers.push_back(std::thread(&MeshExporter::workerLoop, this));
+    }
+}
+
+MeshExporter::~MeshExporter() {
+    close();
+}
+
+void MeshExporter::submit(GLuint frame, const GLfloat* positions) {
+    if (!open)
+        return;
+
+    std::vector<GLfloat> buffer;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (freeBuffers.empty()) {
+            // The writers are behind and the queue is full, skip the frame rather than hold up the simulation
+            skippedFrames++;
+            return;
+        }
+        buffer.swap(freeBuffers.back());
+        freeBuffers.pop_back();
+    }
+
+    std::memcpy(buffer.data(), positions, 3 * particleCount * sizeof(GLfloat));
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(Job());
+        queue.back().frame = frame;
+        queue.back().positions.swap(buffer);
+    }
+    jobQueued.notify_one();
+}
+
+void MeshExporter::close() {
+    if (!open)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    jobQueued.notify_all();
+    for (GLuint i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+
+    if (failures > 0)
+        std::cerr << "Failed to export " << failures << " meshes to " << directory << std::endl;
+    if (skippedFrames > 0)
+        std::cerr << "Mesh export fell behind the simulation and skipped " << skippedFrames << " frames, "
+                  << "consider more writer threads" << std::endl;
+    open = false;
+}
+
+bool MeshExporter::isOpen() {
+    return open;
+}
+
+bool MeshExporter::parseFormat(std::string name, MeshFormat& format) {
+    if (name == "ply") {
+        format = MESH_PLY;
+        return true;
+    }
+    if (name == "obj") {
+        format = MESH_OBJ;
+        return true;
+    }
+    return false;
+}
+
+void MeshExporter::workerLoop() {
+    PROFILE_THREAD_NAME("exporter");
+
+    // Formatting buffer reused for every file this worker writes
+    std::vector<char> buffer;
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true) {
+        jobQueued.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        Job job;
+        job.frame = queue.front().frame;
+        job.positions.swap(queue.front().positions);
+        queue.pop_front();
+        lock.unlock();
+
+        bool written;
+        {
+            PROFILE_SCOPE(PHASE_EXPORT);
+            written = format == MESH_PLY ? writePly(job, buffer) : writeObj(job, buffer);
+        }
+
+        lock.lock();
+        if (!written)
+            failures++;
+        freeBuffers.push_back(std::vector<GLfloat>());
+        freeBuffers.back().swap(job.positions);
+    }
+}
+
+bool MeshExporter::writePly(const Job& job, std::vector<char>& buffer) {
+    std::ostringstream header;
+    header << "ply" << "\n"
+           << "format binary_little_endian 1.0" << "\n"
+           << "element vertex " << particleCount << "\n"
+           << "property float x" << "\n"
+           << "property float y" << "\n"
+           << "property float z" << "\n"
+           << "element face " << indices.size() / 3 << "\n"
+           << "property list uchar int vertex_indices" << "\n"
+           << "end_header" << "\n";
+    std::string headerText = header.str();
+
+    // The face records are a count byte followed by three indices
+    size_t faceSize = 1 + 3 * sizeof(GLint);
+    buffer.resize(headerText.size() + job.positions.size() * sizeof(GLfloat) + indices.size() / 3 * faceSize);
+
+    char* out = buffer.data();
+    std::memcpy(out, headerText.data(), headerText.size());
+    out += headerText.size();
+    std::memcpy(out, job.positions.data(), job.positions.size() * sizeof(GLfloat));
+    out += job.positions.size() * sizeof(GLfloat);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        *out++ = 3;
+        GLint triangle[3] = {(GLint)indices[t], (GLint)indices[t + 1], (GLint)indices[t + 2]};
+        std::memcpy(out, triangle, sizeof(triangle));
+        out += sizeof(triangle);
+    }
+
+    std::ofstream file(framePath(job.frame).c_str(), std::ios::binary);
+    file.write(buffer.data(), buffer.size());
+    return file.good();
+}
+
+bool MeshExporter::writeObj(const Job& job, std::vector<char>& buffer) {
+    // Large enough for any vertex or face line
+    const size_t LINE = 128;
+    buffer.resize(particleCount * LINE + indices.size() / 3 * LINE);
+
+    char* out = buffer.data();
+    for (GLuint p = 0; p < particleCount; p++) {
+        out += std::snprintf(out, LINE, "v %.7g %.7g %.7g\n",
+                             job.positions[3 * p], job.positions[3 * p + 1], job.positions[3 * p + 2]);
+    }
+    // OBJ indices start at one
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        out += std::snprintf(out, LINE, "f %u %u %u\n", indices[t] + 1, indices[t + 1] + 1, indices[t + 2] + 1);
+    }
+
+    std::ofstream file(framePath(job.frame).c_str(), std::ios::binary);
+    file.write(buffer.data(), out - buffer.data());
+    return file.good();
+}
+
+std::string MeshExporter::framePath(GLuint frame) {
+    std::ostringstream name;
+    name << directory << "/cloth_" << std::setw(5) << std::setfill('0') << frame
+         << (format == MESH_PLY ? ".ply" : ".obj");
+    return name.str();
+}
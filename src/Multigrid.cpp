@@ -0,0 +1,383 @@
+#include "Multigrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Sweeps standing in for the coarsest solve when it is too large to factor
+static const GLuint COARSEST_SWEEPS = 20;
+
+// Coarse nodes and weights a node of a line of length nodes interpolates from, returns their number.
+// Lines of more than two nodes keep their even nodes, shorter ones are not coarsened.
+static GLuint interpolation(GLuint node, GLuint length, GLuint* from, GLfloat* weights) {
+    if (length <= 2) {
+        from[0] = node;
+        weights[0] = 1.0f;
+        return 1;
+    }
+    GLuint coarseLength = (length + 1) / 2;
+    if (node % 2 == 0) {
+        from[0] = node / 2;
+        weights[0] = 1.0f;
+        return 1;
+    }
+    if ((node + 1) / 2 < coarseLength) {
+        from[0] = node / 2;
+        from[1] = node / 2 + 1;
+        weights[0] = weights[1] = 0.5f;
+        return 2;
+    }
+    // The last node of a line of even length is beyond the last coarse node
+    from[0] = node / 2;
+    weights[0] = 1.0f;
+    return 1;
+}
+
+static GLuint coarseLength(GLuint length) {
+    return length <= 2 ? length : (length + 1) / 2;
+}
+
+Multigrid::Multigrid() : pool(nullptr) {}
+
+void Multigrid::setThreadPool(ThreadPool* thePool) {
+    pool = thePool;
+}
+
+GLuint Multigrid::getLevelCount() {
+    return (GLuint)levels.size();
+}
+
+GLuint Multigrid::getUnknownCount(GLuint level) {
+    return levels[level].matrix.rowCount;
+}
+
+// The bilinear prolongation from the coarsened grids, whose layout goes to coarseGrids
+SparseMatrix Multigrid::coarsen(const std::vector<GridLayout>& grids, std::vector<GridLayout>& coarseGrids) {
+    std::vector<MatrixEntry> entries;
+    GLuint fineCount = 0, coarseCount = 0;
+    coarseGrids.clear();
+    for (GLuint g = 0; g < grids.size(); g++) {
+        const GridLayout& grid = grids[g];
+        GridLayout coarse = {coarseCount, coarseLength(grid.width), coarseLength(grid.height)};
+        coarseGrids.push_back(coarse);
+
+        for (GLuint i = 0; i < grid.height; i++) {
+            GLuint rows[2], columns[2];
+            GLfloat rowWeights[2], columnWeights[2];
+            GLuint rowCount = interpolation(i, grid.height, rows, rowWeights);
+            for (GLuint j = 0; j < grid.width; j++) {
+                GLuint columnCount = interpolation(j, grid.width, columns, columnWeights);
+                for (GLuint a = 0; a < rowCount; a++) {
+                    for (GLuint c = 0; c < columnCount; c++) {
+                        MatrixEntry entry = {grid.first + i * grid.width + j,
+                                             coarse.first + rows[a] * coarse.width + columns[c],
+                                             rowWeights[a] * columnWeights[c]};
+                        entries.push_back(entry);
+                    }
+                }
+            }
+        }
+        fineCount = std::max(fineCount, grid.first + grid.width * grid.height);
+        coarseCount += coarse.width * coarse.height;
+    }
+    return SparseMatrix::fromEntries(fineCount, coarseCount, entries);
+}
+
+void Multigrid::build(const SparseMatrix& matrix, const std::vector<GridLayout>& grids,
+                      const std::vector<unsigned char>& theFixed) {
+    fixed = theFixed;
+    levels.clear();
+    levels.push_back(Level());
+    levels[0].matrix = matrix;
+    levels[0].grids = grids;
+
+    // Coarsen until the coarsest level can be factored, or stops getting smaller
+    while (levels.back().matrix.rowCount > MAX_COARSEST) {
+        std::vector<GridLayout> coarseGrids;
+        SparseMatrix prolongation = coarsen(levels.back().grids, coarseGrids);
+        if (5 * prolongation.columnCount > 4 * prolongation.rowCount)
+            break;
+
+        Level coarse;
+        coarse.matrix = prolongation.transpose().multiply(levels.back().matrix.multiply(prolongation));
+        coarse.grids = coarseGrids;
+        levels.back().restriction = prolongation.transpose();
+        levels.back().prolongation = prolongation;
+        levels.push_back(coarse);
+    }
+
+    for (GLuint l = 0; l < levels.size(); l++) {
+        Level& level = levels[l];
+        GLuint count = level.matrix.rowCount;
+        level.inverseDiagonal.resize(count);
+        for (GLuint i = 0; i < count; i++) {
+            GLfloat diagonal = 0.0f;
+            for (GLuint n = level.matrix.rowStart[i]; n < level.matrix.rowStart[i + 1]; n++)
+                diagonal += std::fabs(level.matrix.values[n]);
+            level.inverseDiagonal[i] = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+        }
+        level.b.assign(count, glm::vec3(0.0f));
+        level.x.assign(count, glm::vec3(0.0f));
+        level.r.assign(count, glm::vec3(0.0f));
+    }
+    factorCoarsest();
+
+    GLuint count = matrix.rowCount;
+    residual.assign(count, glm::vec3(0.0f));
+    direction.assign(count, glm::vec3(0.0f));
+    preconditioned.assign(count, glm::vec3(0.0f));
+    product.assign(count, glm::vec3(0.0f));
+    blockSums.assign((count + BLOCK_SIZE - 1) / BLOCK_SIZE, glm::dvec3(0.0));
+}
+
+// Dense Cholesky factorisation of the coarsest matrix, left empty when it is too large or not
+// positive definite, the coarsest level is then only smoothed
+void Multigrid::factorCoarsest() {
+    const SparseMatrix& matrix = levels.back().matrix;
+    GLuint n = matrix.rowCount;
+    coarsestFactor.clear();
+    coarsestWork.clear();
+    if (n > MAX_COARSEST)
+        return;
+
+    std::vector<double> factor((size_t)n * n, 0.0);
+    for (GLuint r = 0; r < n; r++) {
+        for (GLuint k = matrix.rowStart[r]; k < matrix.rowStart[r + 1]; k++)
+            factor[(size_t)r * n + matrix.columns[k]] = matrix.values[k];
+    }
+    for (GLuint j = 0; j < n; j++) {
+        double pivot = factor[(size_t)j * n + j];
+        for (GLuint k = 0; k < j; k++)
+            pivot -= factor[(size_t)j * n + k] * factor[(size_t)j * n + k];
+        if (!(pivot > 0.0))
+            return;
+        pivot = std::sqrt(pivot);
+        factor[(size_t)j * n + j] = pivot;
+        for (GLuint i = j + 1; i < n; i++) {
+            double value = factor[(size_t)i * n + j];
+            for (GLuint k = 0; k < j; k++)
+                value -= factor[(size_t)i * n + k] * factor[(size_t)j * n + k];
+            factor[(size_t)i * n + j] = value / pivot;
+        }
+    }
+    coarsestFactor.swap(factor);
+    coarsestWork.assign(n, glm::dvec3(0.0));
+}
+
+void Multigrid::forEachBlock(GLuint count, BlockFunction work) {
+    if (pool) {
+        pool->parallelFor(count, BLOCK_SIZE, work);
+        return;
+    }
+    for (GLuint begin = 0; begin < count; begin += BLOCK_SIZE)
+        work(begin, std::min(begin + BLOCK_SIZE, count));
+}
+
+glm::dvec3 Multigrid::dot(const glm::vec3* a, const glm::vec3* b) {
+    GLuint count = levels[0].matrix.rowCount;
+    forEachBlock(count, [&](GLuint begin, GLuint end) {
+        glm::dvec3 sum(0.0);
+        for (GLuint i = begin; i < end; i++)
+            sum += glm::dvec3(a[i] * b[i]);
+        blockSums[begin / BLOCK_SIZE] = sum;
+    });
+
+    glm::dvec3 sum(0.0);
+    for (GLuint block = 0; block < blockSums.size(); block++)
+        sum += blockSums[block];
+    return sum;
+}
+
+// l1 Jacobi sweeps on x, which is taken as zero when fromZero is set. Dividing by the sum of the
+// magnitudes of a row instead of its diagonal damps the sweeps just enough to converge for any
+// symmetric positive definite matrix, the Galerkin matrices of the coarse levels included.
+void Multigrid::smooth(GLuint l, const glm::vec3* b, glm::vec3* x, bool fromZero) {
+    Level& level = levels[l];
+    GLuint count = level.matrix.rowCount;
+    for (GLuint sweep = 0; sweep < SMOOTHING_SWEEPS; sweep++) {
+        if (fromZero && sweep == 0) {
+            forEachBlock(count, [&](GLuint begin, GLuint end) {
+                for (GLuint i = begin; i < end; i++)
+                    x[i] = level.inverseDiagonal[i] * b[i];
+            });
+            continue;
+        }
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            level.matrix.multiply(x, level.r.data(), begin, end);
+            for (GLuint i = begin; i < end; i++)
+                level.r[i] = b[i] - level.r[i];
+        });
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            for (GLuint i = begin; i < end; i++)
+                x[i] += level.inverseDiagonal[i] * level.r[i];
+        });
+    }
+}
+
+// Approximately solves the matrix of a level for b, from x = 0
+void Multigrid::vCycle(GLuint l, const glm::vec3* b, glm::vec3* x) {
+    if (l + 1 == levels.size()) {
+        solveCoarsest(b, x);
+        return;
+    }
+    Level& level = levels[l];
+    Level& coarse = levels[l + 1];
+    GLuint count = level.matrix.rowCount;
+
+    smooth(l, b, x, true);
+
+    forEachBlock(count, [&](GLuint begin, GLuint end) {
+        level.matrix.multiply(x, level.r.data(), begin, end);
+        for (GLuint i = begin; i < end; i++)
+            level.r[i] = b[i] - level.r[i];
+    });
+    forEachBlock(coarse.matrix.rowCount, [&](GLuint begin, GLuint end) {
+        level.restriction.multiply(level.r.data(), coarse.b.data(), begin, end);
+    });
+
+    vCycle(l + 1, coarse.b.data(), coarse.x.data());
+
+    const SparseMatrix& prolongation = level.prolongation;
+    forEachBlock(count, [&](GLuint begin, GLuint end) {
+        for (GLuint i = begin; i < end; i++) {
+            for (GLuint n = prolongation.rowStart[i]; n < prolongation.rowStart[i + 1]; n++)
+                x[i] += prolongation.values[n] * coarse.x[prolongation.columns[n]];
+        }
+    });
+
+    smooth(l, b, x, false);
+}
+
+void Multigrid::solveCoarsest(const glm::vec3* b, glm::vec3* x) {
+    GLuint l = (GLuint)levels.size() - 1;
+    if (coarsestFactor.empty()) {
+        for (GLuint sweeps = 0; sweeps < COARSEST_SWEEPS; sweeps += SMOOTHING_SWEEPS)
+            smooth(l, b, x, sweeps == 0);
+        return;
+    }
+
+    // L y = b, then L^T x = y
+    GLuint n = levels[l].matrix.rowCount;
+    const double* factor = coarsestFactor.data();
+    for (GLuint i = 0; i < n; i++) {
+        glm::dvec3 value(b[i]);
+        for (GLuint k = 0; k < i; k++)
+            value -= factor[(size_t)i * n + k] * coarsestWork[k];
+        coarsestWork[i] = value / factor[(size_t)i * n + i];
+    }
+    for (GLuint i = n; i-- > 0;) {
+        glm::dvec3 value = coarsestWork[i];
+        for (GLuint k = i + 1; k < n; k++)
+            value -= factor[(size_t)k * n + i] * coarsestWork[k];
+        coarsestWork[i] = value / factor[(size_t)i * n + i];
+        x[i] = glm::vec3(coarsestWork[i]);
+    }
+}
+
+// z = an approximate inverse of the matrix times r, zero for the fixed unknowns
+void Multigrid::precondition(const glm::vec3* r, glm::vec3* z, MultigridUse use) {
+    const Level& finest = levels[0];
+    GLuint count = finest.matrix.rowCount;
+    if (use == MULTIGRID_NONE) {
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            for (GLuint i = begin; i < end; i++)
+                z[i] = finest.inverseDiagonal[i] * r[i];
+        });
+    } else {
+        vCycle(0, r, z);
+    }
+    forEachBlock(count, [&](GLuint begin, GLuint end) {
+        for (GLuint i = begin; i < end; i++) {
+            if (fixed[i])
+                z[i] = glm::vec3(0.0f);
+        }
+    });
+}
+
+GLuint Multigrid::solve(const glm::vec3* b, glm::vec3* x, GLfloat tolerance, GLuint maxIterations,
+                        MultigridUse use) {
+    const SparseMatrix& matrix = levels[0].matrix;
+    GLuint count = matrix.rowCount;
+
+    glm::dvec3 bb = dot(b, b);
+    double threshold = (double)tolerance * tolerance * std::max(bb.x, std::max(bb.y, bb.z));
+    if (threshold == 0.0) {
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            std::fill(x + begin, x + end, glm::vec3(0.0f));
+        });
+        return 0;
+    }
+
+    forEachBlock(count, [&](GLuint begin, GLuint end) {
+        matrix.multiply(x, residual.data(), begin, end);
+        for (GLuint i = begin; i < end; i++)
+            residual[i] = b[i] - residual[i];
+    });
+    glm::dvec3 rr = dot(residual.data(), residual.data());
+
+    if (use == MULTIGRID_SOLVER) {
+        // Stationary iteration x += V-cycle(b - A x). The residual is computed anew every time, so it
+        // stops falling at the rounding error of single precision, which ends the iteration as well.
+        GLuint iteration = 0;
+        glm::dvec3 previous(INFINITY);
+        for (; iteration < maxIterations && glm::any(glm::greaterThan(rr, glm::dvec3(threshold)))
+               && glm::any(glm::lessThan(rr, 0.25 * previous)); iteration++) {
+            previous = rr;
+            precondition(residual.data(), preconditioned.data(), use);
+            forEachBlock(count, [&](GLuint begin, GLuint end) {
+                for (GLuint i = begin; i < end; i++)
+                    x[i] += preconditioned[i];
+            });
+            forEachBlock(count, [&](GLuint begin, GLuint end) {
+                matrix.multiply(x, residual.data(), begin, end);
+                for (GLuint i = begin; i < end; i++)
+                    residual[i] = b[i] - residual[i];
+            });
+            rr = dot(residual.data(), residual.data());
+        }
+        return iteration;
+    }
+
+    // Preconditioned conjugate gradients, one per coordinate sharing the matrix products. A
+    // coordinate that has converged stops moving.
+    precondition(residual.data(), preconditioned.data(), use);
+    std::copy(preconditioned.begin(), preconditioned.end(), direction.begin());
+    glm::dvec3 rz = dot(residual.data(), preconditioned.data());
+
+    for (GLuint iteration = 0; iteration < maxIterations; iteration++) {
+        if (!glm::any(glm::greaterThan(rr, glm::dvec3(threshold))))
+            return iteration;
+
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            matrix.multiply(direction.data(), product.data(), begin, end);
+        });
+        glm::dvec3 pq = dot(direction.data(), product.data());
+        glm::vec3 alpha(0.0f);
+        for (GLuint c = 0; c < 3; c++) {
+            if (rr[c] > threshold && pq[c] > 0.0)
+                alpha[c] = (GLfloat)(rz[c] / pq[c]);
+        }
+
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            for (GLuint i = begin; i < end; i++) {
+                x[i] += alpha * direction[i];
+                residual[i] -= alpha * product[i];
+            }
+        });
+        rr = dot(residual.data(), residual.data());
+
+        precondition(residual.data(), preconditioned.data(), use);
+        glm::dvec3 rzNext = dot(residual.data(), preconditioned.data());
+        glm::vec3 beta(0.0f);
+        for (GLuint c = 0; c < 3; c++) {
+            if (rz[c] > 0.0)
+                beta[c] = (GLfloat)(rzNext[c] / rz[c]);
+        }
+        rz = rzNext;
+
+        forEachBlock(count, [&](GLuint begin, GLuint end) {
+            for (GLuint i = begin; i < end; i++)
+                direction[i] = preconditioned[i] + beta * direction[i];
+        });
+    }
+    return maxIterations;
+}
@@ -0,0 +1,87 @@
+#include "Numa.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Parses a kernel list such as "0-3,8-11", false if it is malformed
+static bool parseList(std::string text, std::vector<int>& values) {
+    std::istringstream stream(text);
+    std::string range;
+    values.clear();
+    while (std::getline(stream, range, ',')) {
+        int first, last;
+        char dash;
+        std::istringstream part(range);
+        if (!(part >> first))
+            return false;
+        last = first;
+        if (part >> dash && (dash != '-' || !(part >> last)))
+            return false;
+        if (first < 0 || last < first)
+            return false;
+        for (int value = first; value <= last; value++)
+            values.push_back(value);
+    }
+    return !values.empty();
+}
+
+static bool readList(std::string fileName, std::vector<int>& values) {
+    std::ifstream file(fileName.c_str());
+    std::string line;
+    return std::getline(file, line) && parseList(line, values);
+}
+
+NumaTopology::NumaTopology(const std::vector<std::vector<int>>& theNodes) {
+    nodes = theNodes;
+}
+
+NumaTopology NumaTopology::detect() {
+    std::vector<std::vector<int>> nodes;
+    std::vector<int> online, cpus;
+    if (readList("/sys/devices/system/node/online", online)) {
+        for (size_t i = 0; i < online.size(); i++) {
+            // Nodes with memory but no CPUs cannot run threads
+            if (readList("/sys/devices/system/node/node" + std::to_string(online[i]) + "/cpulist", cpus))
+                nodes.push_back(cpus);
+        }
+    }
+
+    if (nodes.empty()) {
+        GLuint threads = std::max(std::thread::hardware_concurrency(), 1u);
+        nodes.push_back(std::vector<int>());
+        for (GLuint i = 0; i < threads; i++)
+            nodes[0].push_back((int)i);
+    }
+    return NumaTopology(nodes);
+}
+
+GLuint NumaTopology::getNodeCount() const {
+    return (GLuint)nodes.size();
+}
+
+const std::vector<int>& NumaTopology::getCpus(GLuint node) const {
+    return nodes[node];
+}
+
+bool NumaTopology::pinThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
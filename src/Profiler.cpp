@@ -0,0 +1,214 @@
+#include "Profiler.h"
+
+#ifdef TYGLADIG_PROFILING
+
+#include <chrono>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <iomanip>
+#include <algorithm>
+
+// Every buffer ever created, they are kept until exit so reports can include finished threads
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ProfileBuffer>> registry;
+
+static thread_local ProfileBuffer* ownBuffer = nullptr;
+static std::atomic<uint32_t> currentFrame(0);
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+ProfileBuffer::ProfileBuffer(uint32_t theThreadIndex) : threadIndex(theThreadIndex), head(0) {
+    threadName = "thread " + std::to_string(threadIndex);
+    for (uint32_t p = 0; p < PHASE_COUNT; p++) {
+        totals[p].count = 0;
+        totals[p].total = 0;
+        totals[p].min = UINT64_MAX;
+        totals[p].max = 0;
+    }
+    for (uint32_t c = 0; c < COUNTER_COUNT; c++)
+        counters[c] = 0;
+}
+
+void ProfileBuffer::record(uint32_t phase, uint64_t start, uint64_t end) {
+    record(phase, start, end, currentFrame.load(std::memory_order_relaxed));
+}
+
+void ProfileBuffer::record(uint32_t phase, uint64_t start, uint64_t end, uint32_t frame) {
+    uint64_t at = head.load(std::memory_order_relaxed);
+    ProfileSample& sample = samples[at % CAPACITY];
+    sample.phase = phase;
+    sample.frame = frame;
+    sample.start = start;
+    sample.end = end;
+    head.store(at + 1, std::memory_order_release);
+
+    uint64_t duration = end - start;
+    ProfileTotals& phaseTotals = totals[phase];
+    phaseTotals.count++;
+    phaseTotals.total += duration;
+    if (duration < phaseTotals.min)
+        phaseTotals.min = duration;
+    if (duration > phaseTotals.max)
+        phaseTotals.max = duration;
+}
+
+void ProfileBuffer::count(uint32_t counter, uint64_t amount) {
+    counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void ProfileBuffer::getSamples(std::vector<ProfileSample>& out) {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+    for (uint64_t i = begin; i < end; i++)
+        out.push_back(samples[i % CAPACITY]);
+}
+
+ProfileBuffer& Profiler::threadBuffer() {
+    if (ownBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::unique_ptr<ProfileBuffer>(new ProfileBuffer((uint32_t)registry.size())));
+        ownBuffer = registry.back().get();
+    }
+    return *ownBuffer;
+}
+
+ProfileBuffer& Profiler::createBuffer(std::string name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(std::unique_ptr<ProfileBuffer>(new ProfileBuffer((uint32_t)registry.size())));
+    registry.back()->threadName = name;
+    return *registry.back();
+}
+
+std::vector<ProfileBuffer*> Profiler::getBuffers() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<ProfileBuffer*> buffers;
+    for (size_t i = 0; i < registry.size(); i++)
+        buffers.push_back(registry[i].get());
+    return buffers;
+}
+
+uint64_t Profiler::now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::setFrame(uint32_t frame) {
+    currentFrame.store(frame, std::memory_order_relaxed);
+}
+
+uint32_t Profiler::getFrame() {
+    return currentFrame.load(std::memory_order_relaxed);
+}
+
+void Profiler::report(std::ostream& out) {
+    std::vector<ProfileBuffer*> buffers = getBuffers();
+
+    out << std::endl << "Profile over " << buffers.size() << " threads" << std::endl
+        << std::setw(12) << "phase" << std::setw(10) << "count" << std::setw(12) << "total ms"
+        << std::setw(12) << "mean us" << std::setw(12) << "min us" << std::setw(12) << "max us" << std::endl;
+
+    for (uint32_t p = 0; p < PHASE_COUNT; p++) {
+        ProfileTotals sum = {0, 0, UINT64_MAX, 0};
+        for (size_t b = 0; b < buffers.size(); b++) {
+            const ProfileTotals& totals = buffers[b]->totals[p];
+            sum.count += totals.count;
+            sum.total += totals.total;
+            sum.min = std::min(sum.min, totals.min);
+            sum.max = std::max(sum.max, totals.max);
+        }
+        if (sum.count == 0)
+            continue;
+
+        out << std::setw(12) << phaseName(p) << std::setw(10) << sum.count << std::fixed << std::setprecision(2)
+            << std::setw(12) << sum.total / 1e6 << std::setw(12) << sum.total / 1e3 / sum.count
+            << std::setw(12) << sum.min / 1e3 << std::setw(12) << sum.max / 1e3 << std::defaultfloat << std::endl;
+    }
+
+    for (uint32_t c = 0; c < COUNTER_COUNT; c++) {
+        uint64_t total = 0;
+        for (size_t b = 0; b < buffers.size(); b++)
+            total += buffers[b]->counters[c].load(std::memory_order_relaxed);
+        out << std::setw(12) << counterName(c) << std::setw(16) << total << std::endl;
+    }
+}
+
+// Quotes and escapes a string for JSON
+static std::string quote(const std::string& text) {
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\')
+            quoted += '\\';
+        if ((unsigned char)text[i] >= 0x20)
+            quoted += text[i];
+    }
+    return quoted + "\"";
+}
+
+// Trace category of a phase, the trace viewers can filter on it
+static const char* phaseCategory(uint32_t phase) {
+    switch (phase) {
+        case PHASE_FRAME:
+            return "frame";
+        case PHASE_SIMULATE: case PHASE_FORCES: case PHASE_WIND: case PHASE_INTEGRATE: case PHASE_COLLIDE:
+            return "simulation";
+        case PHASE_GPU:
+            return "gpu";
+        case PHASE_CACHE: case PHASE_EXPORT:
+            return "io";
+        default:
+            return "render";
+    }
+}
+
+bool Profiler::writeTrace(std::string fileName) {
+    std::ofstream file(fileName.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    std::vector<ProfileBuffer*> buffers = getBuffers();
+    std::vector<ProfileSample> samples;
+    size_t eventCount = 0;
+
+    // Complete ("X") events with times in microseconds, plus metadata naming and ordering the tracks
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::fixed << std::setprecision(3);
+    for (size_t b = 0; b < buffers.size(); b++) {
+        ProfileBuffer& buffer = *buffers[b];
+        file << (b == 0 ? "" : ",") << std::endl
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.threadIndex
+             << ",\"args\":{\"name\":" << quote(buffer.threadName) << "}}," << std::endl
+             << "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.threadIndex
+             << ",\"args\":{\"sort_index\":" << buffer.threadIndex << "}}";
+
+        samples.clear();
+        buffer.getSamples(samples);
+        for (size_t i = 0; i < samples.size(); i++) {
+            const ProfileSample& sample = samples[i];
+            file << "," << std::endl
+                 << "{\"name\":\"" << phaseName(sample.phase) << "\",\"cat\":\"" << phaseCategory(sample.phase)
+                 << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.threadIndex
+                 << ",\"ts\":" << sample.start / 1e3 << ",\"dur\":" << (sample.end - sample.start) / 1e3
+                 << ",\"args\":{\"frame\":" << sample.frame << "}}";
+        }
+        eventCount += samples.size();
+    }
+    file << std::endl << "]}" << std::endl;
+
+    std::cout << "Wrote " << eventCount << " trace events of " << buffers.size() << " threads to " << fileName << std::endl;
+    return file.good();
+}
+
+const char* Profiler::phaseName(uint32_t phase) {
+    static const char* names[PHASE_COUNT] = {"frame", "simulate", "forces", "wind", "integrate", "collide", "pack",
+                                             "upload", "swap", "gpu", "cache write", "export"};
+    return phase < PHASE_COUNT ? names[phase] : "unknown";
+}
+
+const char* Profiler::counterName(uint32_t counter) {
+    static const char* names[COUNTER_COUNT] = {"springs", "substeps", "iterations"};
+    return counter < COUNTER_COUNT ? names[counter] : "unknown";
+}
+
+#endif //TYGLADIG_PROFILING
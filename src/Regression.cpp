@@ -0,0 +1,264 @@
+#include "Regression.h"
+#include "World.h"
+#include "ThreadPool.h"
+#include "AllocationCounter.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+
+// Removes leading and trailing white space
+static std::string trim(std::string text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+bool Regression::load(std::string fileName) {
+    std::ifstream file(fileName.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open regression file " << fileName << std::endl;
+        return false;
+    }
+
+    // Scene and golden paths are relative to the regression file
+    std::string directory;
+    size_t slash = fileName.find_last_of("/\\");
+    if (slash != std::string::npos)
+        directory = fileName.substr(0, slash + 1);
+
+    bool ok = true;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        if (line == "[case]") {
+            RegressionCase regressionCase;
+            regressionCase.frames = 600;
+            regressionCase.tolerance = 0.0001f;
+            regressionCase.maxStrain = 0.5f;
+            cases.push_back(regressionCase);
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        std::string key = trim(line.substr(0, equals));
+        std::string value = equals == std::string::npos ? "" : trim(line.substr(equals + 1));
+        bool valid = equals != std::string::npos && !cases.empty();
+
+        if (valid) {
+            RegressionCase& regressionCase = cases.back();
+            std::istringstream stream(value);
+            if (key == "scene") {
+                valid = regressionCase.scene.load(directory + value);
+                regressionCase.name = regressionCase.scene.name;
+            } else if (key == "golden")
+                regressionCase.golden = directory + value;
+            else if (key == "frames")
+                valid = stream >> regressionCase.frames && regressionCase.frames > 0;
+            else if (key == "tolerance")
+                valid = stream >> regressionCase.tolerance && regressionCase.tolerance >= 0.0f;
+            else if (key == "maxStrain")
+                valid = stream >> regressionCase.maxStrain && regressionCase.maxStrain > 0.0f;
+            else
+                valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << fileName << ":" << lineNumber << ": invalid line " << line << std::endl;
+            ok = false;
+        }
+    }
+
+    for (GLuint c = 0; c < cases.size(); c++) {
+        if (cases[c].name.empty() || cases[c].golden.empty()) {
+            std::cerr << fileName << ": every case needs a scene and a golden file" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool Regression::run(bool writeGolden, GLuint threadCount) {
+    results.clear();
+    bool passed = true;
+    for (GLuint c = 0; c < cases.size(); c++) {
+        results.push_back(check(cases[c], writeGolden, threadCount));
+        passed = passed && results.back().passed;
+    }
+    return passed;
+}
+
+RegressionResult Regression::check(const RegressionCase& regressionCase, bool writeGolden, GLuint threadCount) {
+    RegressionResult result;
+    result.passed = true;
+    result.deviation = 0.0f;
+    result.energyGain = 0.0f;
+    result.strain = 0.0f;
+    result.deterministic = false;
+    result.allocations = 0;
+
+    // The first frame may still size things, every later one has to run without allocating
+    std::unique_ptr<World> world = World::create(regressionCase.scene);
+    GLfloat startEnergy = world->getEnergy();
+    uint64_t allocationsBefore = 0;
+    for (GLuint f = 0; f < regressionCase.frames; f++) {
+        if (f == 1)
+            allocationsBefore = ALLOCATION_COUNT();
+        world->step(false);
+
+        GLfloat gain = (world->getEnergy() - startEnergy) / world->getEnergyScale();
+        if (!(gain <= result.energyGain))
+            result.energyGain = gain;
+        if (!std::isfinite(gain) || gain > 1.0f) {
+            result.failure = "energy blew up on frame " + std::to_string(f);
+            result.passed = false;
+            return result;
+        }
+    }
+    if (regressionCase.frames > 1)
+        result.allocations = ALLOCATION_COUNT() - allocationsBefore;
+
+    std::vector<GLfloat> positions(3 * world->getParticleCount());
+    world->getPositions(positions.data());
+    for (GLuint i = 0; i < positions.size(); i++) {
+        if (!std::isfinite(positions[i])) {
+            result.failure = "positions are not finite";
+            result.passed = false;
+            return result;
+        }
+    }
+
+    result.strain = world->getMaxStrain();
+    if (result.strain > regressionCase.maxStrain && result.failure.empty())
+        result.failure = "structural springs are overstretched";
+
+    // The same scene on a pool has to give exactly the same state
+    std::unique_ptr<World> threaded = World::create(regressionCase.scene);
+    ThreadPool pool(std::max(threadCount, 2u));
+    threaded->setThreadPool(&pool);
+    for (GLuint f = 0; f < regressionCase.frames; f++) {
+        if (f == 1)
+            allocationsBefore = ALLOCATION_COUNT();
+        threaded->step(false);
+    }
+    if (regressionCase.frames > 1)
+        result.allocations += ALLOCATION_COUNT() - allocationsBefore;
+    result.deterministic = threaded->getStateHash() == world->getStateHash();
+    if (!result.deterministic && result.failure.empty())
+        result.failure = "threaded run differs";
+    if (result.allocations > 0 && result.failure.empty())
+        result.failure = "frames after the first allocated memory";
+
+    if (writeGolden) {
+        if (!writeGoldenFile(regressionCase.golden, positions, regressionCase.frames, world->getStateHash())
+            && result.failure.empty())
+            result.failure = "could not write golden file";
+    } else {
+        std::vector<GLfloat> golden;
+        if (!readGolden(regressionCase.golden, golden)) {
+            if (result.failure.empty())
+                result.failure = "could not read golden file";
+        } else if (golden.size() != positions.size()) {
+            if (result.failure.empty())
+                result.failure = "golden file has a different number of particles";
+        } else {
+            for (GLuint i = 0; i < positions.size(); i++)
+                result.deviation = std::max(result.deviation, std::fabs(positions[i] - golden[i]));
+            if (result.deviation > regressionCase.tolerance && result.failure.empty())
+                result.failure = "positions differ from the golden state";
+        }
+    }
+
+    result.passed = result.failure.empty();
+    return result;
+}
+
+// Golden files are text: a header with the particle count, frames and state hash of the run
+// that wrote them, then the x y z of every particle on a line of its own
+bool Regression::readGolden(std::string fileName, std::vector<GLfloat>& positions) {
+    std::ifstream file(fileName.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open golden file " << fileName << std::endl;
+        return false;
+    }
+
+    std::string line, key;
+    GLuint particles = 0;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream stream(line);
+        stream >> key;
+        if (key == "particles")
+            stream >> particles;
+        else if (key == "positions")
+            break;
+    }
+
+    positions.resize(3 * particles);
+    for (GLuint i = 0; i < positions.size(); i++)
+        file >> positions[i];
+    if (file.fail() || particles == 0) {
+        std::cerr << "Invalid golden file " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Regression::writeGoldenFile(std::string fileName, const std::vector<GLfloat>& positions, GLuint frames, uint64_t hash) {
+    std::ofstream file(fileName.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    // Nine significant digits read back as exactly the same float
+    file << "# Golden state written by TYGlaDig --write-golden" << std::endl
+         << "particles " << positions.size() / 3 << std::endl
+         << "frames " << frames << std::endl
+         << "hash " << std::hex << std::setfill('0') << std::setw(16) << hash << std::setfill(' ') << std::dec << std::endl
+         << "positions" << std::endl << std::setprecision(9);
+    for (GLuint i = 0; i + 2 < positions.size(); i += 3)
+        file << positions[i] << " " << positions[i + 1] << " " << positions[i + 2] << std::endl;
+    std::cout << "Wrote " << fileName << std::endl;
+    return file.good();
+}
+
+void Regression::report(std::ostream& out) {
+    out << std::setw(16) << "case" << std::setw(10) << "frames" << std::setw(14) << "deviation"
+        << std::setw(14) << "energy gain" << std::setw(10) << "strain" << std::setw(10) << "threads"
+        << std::setw(8) << "allocs" << std::setw(8) << "result" << std::endl;
+
+    GLuint failed = 0;
+    for (GLuint c = 0; c < results.size(); c++) {
+        const RegressionResult& result = results[c];
+#ifdef TYGLADIG_COUNT_ALLOCATIONS
+        std::string allocations = std::to_string(result.allocations);
+#else
+        std::string allocations = "-";
+#endif
+        out << std::setw(16) << cases[c].name << std::setw(10) << cases[c].frames << std::setprecision(3)
+            << std::setw(14) << result.deviation << std::setw(14) << result.energyGain << std::setw(10) << result.strain
+            << std::setprecision(6) << std::setw(10) << (result.deterministic ? "same" : "DIFFER")
+            << std::setw(8) << allocations << std::setw(8) << (result.passed ? "ok" : "FAIL") << std::endl;
+        if (!result.passed) {
+            out << std::setw(16) << "" << "  " << result.failure << std::endl;
+            failed++;
+        }
+    }
+    out << results.size() - failed << " of " << results.size() << " cases passed" << std::endl;
+}
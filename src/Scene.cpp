@@ -0,0 +1,527 @@
+#include "Scene.h"
+#include "ClothMesh.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+// Removes leading and trailing white space
+static std::string trim(std::string text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+static bool parseFloat(std::string value, GLfloat& result) {
+    std::istringstream stream(value);
+    stream >> result;
+    return !stream.fail() && stream.eof();
+}
+
+static bool parseUint(std::string value, GLuint& result) {
+    std::istringstream stream(value);
+    long number;
+    stream >> number;
+    if (stream.fail() || !stream.eof() || number < 0)
+        return false;
+    result = (GLuint)number;
+    return true;
+}
+
+static bool parseVec3(std::string value, glm::vec3& result) {
+    std::istringstream stream(value);
+    stream >> result.x >> result.y >> result.z;
+    return !stream.fail() && stream.eof();
+}
+
+static bool parsePair(std::string value, GLfloat& first, GLfloat& second) {
+    std::istringstream stream(value);
+    stream >> first >> second;
+    return !stream.fail() && stream.eof();
+}
+
+// "row column", or only the vertex of a mesh, which is the column in row 0
+static bool parsePin(std::string value, std::vector<Pin>& pins) {
+    std::istringstream stream(value);
+    Pin pin;
+    stream >> pin.row;
+    if (stream.fail())
+        return false;
+    if (stream.eof()) {
+        pin.column = pin.row;
+        pin.row = 0;
+    } else {
+        stream >> pin.column;
+        if (stream.fail() || !stream.eof())
+            return false;
+    }
+    pins.push_back(pin);
+    return true;
+}
+
+// The cloth hangs from its top corners
+static void pinTopCorners(ClothSettings& cloth) {
+    cloth.pins.clear();
+    Pin topLeft = {0, 0};
+    Pin topRight = {0, cloth.width - 1};
+    cloth.pins.push_back(topLeft);
+    cloth.pins.push_back(topRight);
+}
+
+Scene::Scene() {
+    name = "default";
+
+    material.k = 1.0f;
+    material.b = 0.1f;
+    material.mass = 1.0f;
+    material.tearStrain = 0.0f;
+    material.bendStiffness = 0.001f;
+
+    cloths.push_back(defaultCloth());
+
+    solver.h = 0.007f;
+    solver.substeps = 1;
+    solver.gravity = glm::vec3(0.0f, -0.00098f * 2, 0.0f);
+    solver.method = SOLVER_EXPLICIT;
+    solver.multigrid = MULTIGRID_PRECONDITIONER;
+    solver.tolerance = 1e-4f;
+    solver.maxIterations = 100;
+    solver.tethers = false;
+    solver.tetherSlack = 0.0f;
+    solver.adaptive = false;
+    solver.errorTolerance = 0.001f;
+    solver.minH = 0.0001f;
+    solver.maxH = 0.0f;
+    solver.cfl = 0.5f;
+    solver.precision = PRECISION_FLOAT;
+    solver.quantisedRestLengths = false;
+    solver.particleOrder = ORDER_GRID;
+    solver.bending = BENDING_SPRINGS;
+
+    push = glm::vec3(0.0f, 0.0f, 0.4f);
+
+    wind.type = WIND_NONE;
+    wind.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+    wind.density = 1.0f;
+    wind.drag = 1.0f;
+    wind.lift = 0.5f;
+    wind.turbulence = 0.0f;
+    wind.turbulenceScale = 2.0f;
+    wind.turbulenceFrequency = 0.5f;
+    wind.gustStrength = 1.0f;
+    wind.gustPeriod = 3.0f;
+}
+
+bool Scene::load(std::string fileName) {
+    std::ifstream file(fileName.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open scene " << fileName << std::endl;
+        return false;
+    }
+
+    name = fileName;
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos)
+        name = name.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos)
+        name = name.substr(0, dot);
+
+    // Pins in the file replace the default ones
+    std::vector<bool> pinsGiven(cloths.size(), false);
+    GLuint cloth = 0;
+    bool clothSeen = false;
+    bool ok = true;
+    std::string section, line;
+    int lineNumber = 0;
+
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        if (line[0] == '[' && line[line.size() - 1] == ']') {
+            section = trim(line.substr(1, line.size() - 2));
+            if (section == "collider") {
+                Collider collider;
+                collider.type = COLLIDER_SPHERE;
+                collider.center = glm::vec3(0.0f, 0.0f, 0.0f);
+                collider.radius = 0.0f;
+                collider.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+                collider.offset = 0.0f;
+                colliders.push_back(collider);
+            } else if (section == "cloth") {
+                if (clothSeen) {
+                    cloths.push_back(defaultCloth());
+                    pinsGiven.push_back(false);
+                    cloth = (GLuint)cloths.size() - 1;
+                }
+                clothSeen = true;
+            }
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << fileName << ":" << lineNumber << ": expected key = value" << std::endl;
+            ok = false;
+            continue;
+        }
+
+        std::string key = trim(line.substr(0, equals));
+        if ((section == "pins" || (section == "cloth" && key == "pin")) && !pinsGiven[cloth]) {
+            cloths[cloth].pins.clear();
+            pinsGiven[cloth] = true;
+        }
+        if (!setValue(section, key, trim(line.substr(equals + 1)), cloths[cloth])) {
+            std::cerr << fileName << ":" << lineNumber << ": invalid setting " << key
+                      << " in section [" << section << "]" << std::endl;
+            ok = false;
+        }
+    }
+
+    // Mesh files are relative to the scene file
+    std::string directory;
+    size_t directoryEnd = fileName.find_last_of("/\\");
+    if (directoryEnd != std::string::npos)
+        directory = fileName.substr(0, directoryEnd + 1);
+
+    for (GLuint c = 0; c < cloths.size(); c++) {
+        ClothSettings& cloth = cloths[c];
+        if (!cloth.meshFile.empty()) {
+            std::string path = cloth.meshFile[0] == '/' ? cloth.meshFile : directory + cloth.meshFile;
+            std::shared_ptr<ClothMesh> mesh(new ClothMesh());
+            if (mesh->read(path)) {
+                cloth.mesh = mesh;
+                cloth.width = (GLuint)mesh->positions.size();
+                cloth.height = 1;
+            } else {
+                ok = false;
+            }
+        }
+
+        // Without pins in the file a cloth hangs from its top corners, a mesh falls
+        if (!pinsGiven[c]) {
+            if (!cloth.meshFile.empty())
+                cloth.pins.clear();
+            else
+                pinTopCorners(cloth);
+        }
+
+        const ClothSettings& settings = cloths[c];
+        for (GLuint i = 0; i < settings.pins.size(); i++) {
+            if (settings.pins[i].row >= settings.height || settings.pins[i].column >= settings.width) {
+                std::cerr << fileName << ": pin " << settings.pins[i].row << " " << settings.pins[i].column
+                          << " is outside cloth " << c << std::endl;
+                ok = false;
+            }
+        }
+        if ((settings.meshFile.empty() && (settings.width < 2 || settings.height < 2)) || settings.copiesX == 0
+            || settings.copiesZ == 0 || getMaterial(c).mass <= 0.0f) {
+            std::cerr << fileName << ": cloth " << c << " needs at least 2x2 particles, one copy and a positive mass"
+                      << std::endl;
+            ok = false;
+        }
+    }
+    // Springs index the material of their cloth section in 13 bits
+    if (cloths.size() > (1u << 13)) {
+        std::cerr << fileName << ": a scene can have at most " << (1u << 13) << " cloth sections" << std::endl;
+        ok = false;
+    }
+    if (solver.substeps == 0) {
+        std::cerr << fileName << ": the solver needs at least one substep" << std::endl;
+        ok = false;
+    }
+    // The implicit and projective systems are set up once for the springs of the scene
+    if (solver.method != SOLVER_EXPLICIT && canTear()) {
+        std::cerr << fileName << ": only the explicit solver can simulate tearing" << std::endl;
+        ok = false;
+    }
+    // The bending matrix is set up once for the triangles of the scene, and only the explicit
+    // integrator evaluates its forces
+    if (solver.bending == BENDING_QUADRATIC && (solver.method != SOLVER_EXPLICIT || canTear())) {
+        std::cerr << fileName << ": quadratic bending needs the explicit solver and a cloth that does not tear" << std::endl;
+        ok = false;
+    }
+    // Adaptive steps are taken back when too large, which tearing cannot be
+    if (solver.adaptive && (solver.method != SOLVER_EXPLICIT || canTear())) {
+        std::cerr << fileName << ": adaptive steps need the explicit solver and a cloth that does not tear" << std::endl;
+        ok = false;
+    }
+    // The multigrid hierarchy coarsens the grids of the cloths row by row
+    bool meshes = false;
+    for (GLuint c = 0; c < cloths.size(); c++)
+        meshes = meshes || !cloths[c].meshFile.empty();
+    if (meshes && solver.method == SOLVER_IMPLICIT) {
+        std::cerr << fileName << ": the implicit solver needs grids, it cannot simulate a mesh" << std::endl;
+        ok = false;
+    }
+    if (solver.particleOrder != ORDER_GRID && solver.method == SOLVER_IMPLICIT) {
+        std::cerr << fileName << ": the implicit solver needs the particles in grid order" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+Material Scene::getMaterial(GLuint cloth) const {
+    Material result = material;
+    const Material& own = cloths[cloth].material;
+    if (own.k >= 0.0f)
+        result.k = own.k;
+    if (own.b >= 0.0f)
+        result.b = own.b;
+    if (own.mass >= 0.0f)
+        result.mass = own.mass;
+    if (own.tearStrain >= 0.0f)
+        result.tearStrain = own.tearStrain;
+    if (own.bendStiffness >= 0.0f)
+        result.bendStiffness = own.bendStiffness;
+    return result;
+}
+
+bool Scene::canTear() const {
+    for (GLuint c = 0; c < cloths.size(); c++) {
+        if (getMaterial(c).tearStrain > 0.0f)
+            return true;
+    }
+    return false;
+}
+
+ClothSettings Scene::defaultCloth() {
+    ClothSettings cloth;
+    // Always use an odd number
+    cloth.width = 9;
+    cloth.height = 9;
+    cloth.restLength = 0.1f;
+    cloth.corner = glm::vec3(-0.5f, 0.0f, 0.5f);
+    cloth.material.k = -1.0f;
+    cloth.material.b = -1.0f;
+    cloth.material.mass = -1.0f;
+    cloth.material.tearStrain = -1.0f;
+    cloth.material.bendStiffness = -1.0f;
+    pinTopCorners(cloth);
+    cloth.copiesX = 1;
+    cloth.copiesZ = 1;
+    cloth.spacingX = 1.0f;
+    cloth.spacingZ = 1.0f;
+    return cloth;
+}
+
+bool Scene::setValue(std::string section, std::string key, std::string value, ClothSettings& cloth) {
+    if (section == "material") {
+        if (key == "k")
+            return parseFloat(value, material.k) && material.k >= 0.0f;
+        if (key == "b")
+            return parseFloat(value, material.b) && material.b >= 0.0f;
+        if (key == "mass")
+            return parseFloat(value, material.mass) && material.mass > 0.0f;
+        if (key == "tearStrain")
+            return parseFloat(value, material.tearStrain) && material.tearStrain >= 0.0f;
+        if (key == "bendStiffness")
+            return parseFloat(value, material.bendStiffness) && material.bendStiffness >= 0.0f;
+    } else if (section == "cloth") {
+        if (key == "width")
+            return parseUint(value, cloth.width);
+        if (key == "height")
+            return parseUint(value, cloth.height);
+        if (key == "restLength")
+            return parseFloat(value, cloth.restLength) && cloth.restLength > 0.0f;
+        if (key == "corner")
+            return parseVec3(value, cloth.corner);
+        if (key == "mesh") {
+            cloth.meshFile = value;
+            return !value.empty();
+        }
+        if (key == "k")
+            return parseFloat(value, cloth.material.k) && cloth.material.k >= 0.0f;
+        if (key == "b")
+            return parseFloat(value, cloth.material.b) && cloth.material.b >= 0.0f;
+        if (key == "mass")
+            return parseFloat(value, cloth.material.mass) && cloth.material.mass > 0.0f;
+        if (key == "tearStrain")
+            return parseFloat(value, cloth.material.tearStrain) && cloth.material.tearStrain >= 0.0f;
+        if (key == "bendStiffness")
+            return parseFloat(value, cloth.material.bendStiffness) && cloth.material.bendStiffness >= 0.0f;
+        if (key == "pin")
+            return parsePin(value, cloth.pins);
+        if (key == "copies") {
+            std::istringstream stream(value);
+            long alongX, alongZ;
+            stream >> alongX >> alongZ;
+            if (stream.fail() || !stream.eof() || alongX < 1 || alongZ < 1)
+                return false;
+            cloth.copiesX = (GLuint)alongX;
+            cloth.copiesZ = (GLuint)alongZ;
+            return true;
+        }
+        if (key == "spacing")
+            return parsePair(value, cloth.spacingX, cloth.spacingZ);
+    } else if (section == "pins") {
+        if (key == "pin")
+            return parsePin(value, cloth.pins);
+    } else if (section == "solver") {
+        if (key == "h")
+            return parseFloat(value, solver.h) && solver.h > 0.0f;
+        if (key == "substeps")
+            return parseUint(value, solver.substeps);
+        if (key == "gravity")
+            return parseVec3(value, solver.gravity);
+        if (key == "method") {
+            if (value == "explicit")
+                solver.method = SOLVER_EXPLICIT;
+            else if (value == "implicit")
+                solver.method = SOLVER_IMPLICIT;
+            else if (value == "projective")
+                solver.method = SOLVER_PROJECTIVE;
+            else
+                return false;
+            return true;
+        }
+        if (key == "multigrid") {
+            if (value == "preconditioner")
+                solver.multigrid = MULTIGRID_PRECONDITIONER;
+            else if (value == "solver")
+                solver.multigrid = MULTIGRID_SOLVER;
+            else if (value == "none")
+                solver.multigrid = MULTIGRID_NONE;
+            else
+                return false;
+            return true;
+        }
+        if (key == "tolerance")
+            return parseFloat(value, solver.tolerance) && solver.tolerance > 0.0f;
+        if (key == "maxIterations")
+            return parseUint(value, solver.maxIterations) && solver.maxIterations > 0;
+        if (key == "tethers") {
+            if (value == "on")
+                solver.tethers = true;
+            else if (value == "off")
+                solver.tethers = false;
+            else
+                return false;
+            return true;
+        }
+        if (key == "tetherSlack")
+            return parseFloat(value, solver.tetherSlack) && solver.tetherSlack >= 0.0f;
+        if (key == "adaptive") {
+            if (value == "on")
+                solver.adaptive = true;
+            else if (value == "off")
+                solver.adaptive = false;
+            else
+                return false;
+            return true;
+        }
+        if (key == "errorTolerance")
+            return parseFloat(value, solver.errorTolerance) && solver.errorTolerance > 0.0f;
+        if (key == "minH")
+            return parseFloat(value, solver.minH) && solver.minH > 0.0f;
+        if (key == "maxH")
+            return parseFloat(value, solver.maxH) && solver.maxH >= 0.0f;
+        if (key == "cfl")
+            return parseFloat(value, solver.cfl) && solver.cfl > 0.0f;
+        if (key == "precision") {
+            if (value == "float")
+                solver.precision = PRECISION_FLOAT;
+            else if (value == "double")
+                solver.precision = PRECISION_DOUBLE;
+            else if (value == "mixed")
+                solver.precision = PRECISION_MIXED;
+            else
+                return false;
+            return true;
+        }
+        if (key == "restLengths") {
+            if (value == "exact")
+                solver.quantisedRestLengths = false;
+            else if (value == "quantised")
+                solver.quantisedRestLengths = true;
+            else
+                return false;
+            return true;
+        }
+        if (key == "particleOrder") {
+            if (value == "grid")
+                solver.particleOrder = ORDER_GRID;
+            else if (value == "morton")
+                solver.particleOrder = ORDER_MORTON;
+            else
+                return false;
+            return true;
+        }
+        if (key == "bending") {
+            if (value == "springs")
+                solver.bending = BENDING_SPRINGS;
+            else if (value == "quadratic")
+                solver.bending = BENDING_QUADRATIC;
+            else
+                return false;
+            return true;
+        }
+    } else if (section == "interaction") {
+        if (key == "push")
+            return parseVec3(value, push);
+    } else if (section == "collider") {
+        Collider& collider = colliders.back();
+        if (key == "type") {
+            if (value == "sphere")
+                collider.type = COLLIDER_SPHERE;
+            else if (value == "plane")
+                collider.type = COLLIDER_PLANE;
+            else
+                return false;
+            return true;
+        }
+        if (key == "center")
+            return parseVec3(value, collider.center);
+        if (key == "radius")
+            return parseFloat(value, collider.radius);
+        if (key == "normal") {
+            if (!parseVec3(value, collider.normal) || glm::length(collider.normal) == 0.0f)
+                return false;
+            collider.normal = glm::normalize(collider.normal);
+            return true;
+        }
+        if (key == "offset")
+            return parseFloat(value, collider.offset);
+    } else if (section == "wind") {
+        if (key == "type") {
+            if (value == "none")
+                wind.type = WIND_NONE;
+            else if (value == "uniform")
+                wind.type = WIND_UNIFORM;
+            else if (value == "turbulent")
+                wind.type = WIND_TURBULENT;
+            else if (value == "gusts")
+                wind.type = WIND_GUSTS;
+            else
+                return false;
+            return true;
+        }
+        if (key == "velocity")
+            return parseVec3(value, wind.velocity);
+        if (key == "density")
+            return parseFloat(value, wind.density);
+        if (key == "drag")
+            return parseFloat(value, wind.drag);
+        if (key == "lift")
+            return parseFloat(value, wind.lift);
+        if (key == "turbulence")
+            return parseFloat(value, wind.turbulence);
+        if (key == "turbulenceScale")
+            return parseFloat(value, wind.turbulenceScale);
+        if (key == "turbulenceFrequency")
+            return parseFloat(value, wind.turbulenceFrequency);
+        if (key == "gustStrength")
+            return parseFloat(value, wind.gustStrength);
+        if (key == "gustPeriod")
+            return parseFloat(value, wind.gustPeriod) && wind.gustPeriod > 0.0f;
+    }
+    return false;
+}
@@ -0,0 +1,181 @@
+#include "SparseCholesky.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+SparseCholesky::SparseCholesky() : count(0) {}
+
+// Breadth first search from root over the unknowns not yet numbered, levels of the reached
+// unknowns are set in level and the unknowns listed in reached in the order they are found.
+// Returns the number of levels.
+static GLuint breadthFirst(const SparseMatrix& matrix, GLuint root, const std::vector<bool>& numbered,
+                           std::vector<GLuint>& level, std::vector<GLuint>& reached) {
+    reached.clear();
+    reached.push_back(root);
+    level[root] = 0;
+    GLuint levels = 1;
+    for (size_t n = 0; n < reached.size(); n++) {
+        GLuint node = reached[n];
+        for (GLuint k = matrix.rowStart[node]; k < matrix.rowStart[node + 1]; k++) {
+            GLuint other = matrix.columns[k];
+            if (numbered[other] || level[other] != UINT32_MAX)
+                continue;
+            level[other] = level[node] + 1;
+            levels = std::max(levels, level[other] + 1);
+            reached.push_back(other);
+        }
+    }
+    return levels;
+}
+
+// Numbers the unknowns by reverse Cuthill-McKee. Every connected part starts from an unknown at the
+// far end of it, found by searching again from the least connected unknown of the last level
+// for as long as that makes the levels deeper (George and Liu), and the neighbours of every
+// unknown are numbered from the least connected.
+void SparseCholesky::reverseCuthillMcKee(const SparseMatrix& matrix, std::vector<GLuint>& order) {
+    GLuint n = matrix.rowCount;
+    std::vector<GLuint> degree(n);
+    for (GLuint r = 0; r < n; r++)
+        degree[r] = matrix.rowStart[r + 1] - matrix.rowStart[r];
+
+    std::vector<bool> numbered(n, false);
+    std::vector<GLuint> level(n, UINT32_MAX), reached, neighbours;
+    order.clear();
+    order.reserve(n);
+    for (GLuint start = 0; start < n; start++) {
+        if (numbered[start])
+            continue;
+
+        GLuint root = start;
+        GLuint depth = breadthFirst(matrix, root, numbered, level, reached);
+        while (true) {
+            GLuint candidate = root;
+            for (size_t r = 0; r < reached.size(); r++) {
+                GLuint node = reached[r];
+                if (level[node] + 1 == depth && (candidate == root || degree[node] < degree[candidate]))
+                    candidate = node;
+            }
+            for (size_t r = 0; r < reached.size(); r++)
+                level[reached[r]] = UINT32_MAX;
+            GLuint candidateDepth = breadthFirst(matrix, candidate, numbered, level, reached);
+            if (candidateDepth <= depth) {
+                for (size_t r = 0; r < reached.size(); r++)
+                    level[reached[r]] = UINT32_MAX;
+                break;
+            }
+            root = candidate;
+            depth = candidateDepth;
+        }
+
+        // Cuthill-McKee from the root
+        size_t first = order.size();
+        order.push_back(root);
+        numbered[root] = true;
+        for (size_t o = first; o < order.size(); o++) {
+            GLuint node = order[o];
+            neighbours.clear();
+            for (GLuint k = matrix.rowStart[node]; k < matrix.rowStart[node + 1]; k++) {
+                GLuint other = matrix.columns[k];
+                if (!numbered[other]) {
+                    numbered[other] = true;
+                    neighbours.push_back(other);
+                }
+            }
+            std::sort(neighbours.begin(), neighbours.end(), [&degree](GLuint a, GLuint b) {
+                return degree[a] < degree[b] || (degree[a] == degree[b] && a < b);
+            });
+            order.insert(order.end(), neighbours.begin(), neighbours.end());
+        }
+    }
+    std::reverse(order.begin(), order.end());
+}
+
+bool SparseCholesky::factor(const SparseMatrix& matrix) {
+    count = matrix.rowCount;
+    reverseCuthillMcKee(matrix, order);
+    std::vector<GLuint> position(count);
+    for (GLuint i = 0; i < count; i++)
+        position[order[i]] = i;
+
+    // The envelope of the renumbered lower triangle, the factor fills in nothing outside it
+    firstColumn.resize(count);
+    rowStart.resize(count + 1);
+    rowStart[0] = 0;
+    for (GLuint i = 0; i < count; i++) {
+        GLuint row = order[i];
+        GLuint first = i;
+        for (GLuint k = matrix.rowStart[row]; k < matrix.rowStart[row + 1]; k++)
+            first = std::min(first, position[matrix.columns[k]]);
+        firstColumn[i] = first;
+        rowStart[i + 1] = rowStart[i] + (i - first + 1);
+    }
+    values.assign(rowStart[count], 0.0);
+    for (GLuint i = 0; i < count; i++) {
+        GLuint row = order[i];
+        for (GLuint k = matrix.rowStart[row]; k < matrix.rowStart[row + 1]; k++) {
+            GLuint j = position[matrix.columns[k]];
+            if (j <= i)
+                values[rowStart[i] + j - firstColumn[i]] = matrix.values[k];
+        }
+    }
+
+    // Row by row: element j of row i takes the products of rows i and j where both envelopes reach
+    for (GLuint i = 0; i < count; i++) {
+        double* rowI = &values[rowStart[i]] - firstColumn[i];
+        for (GLuint j = firstColumn[i]; j < i; j++) {
+            const double* rowJ = &values[rowStart[j]] - firstColumn[j];
+            double value = rowI[j];
+            for (GLuint k = std::max(firstColumn[i], firstColumn[j]); k < j; k++)
+                value -= rowI[k] * rowJ[k];
+            rowI[j] = value / rowJ[j];
+        }
+        double pivot = rowI[i];
+        for (GLuint k = firstColumn[i]; k < i; k++)
+            pivot -= rowI[k] * rowI[k];
+        if (!(pivot > 0.0)) {
+            std::cerr << "The matrix of " << count << " unknowns is not positive definite" << std::endl;
+            values.clear();
+            count = 0;
+            return false;
+        }
+        rowI[i] = std::sqrt(pivot);
+    }
+
+    work.assign(count, glm::dvec3(0.0));
+    return true;
+}
+
+void SparseCholesky::solve(const glm::vec3* b, glm::vec3* x) {
+    for (GLuint i = 0; i < count; i++)
+        work[i] = glm::dvec3(b[order[i]]);
+
+    // L y = b
+    for (GLuint i = 0; i < count; i++) {
+        const double* rowI = &values[rowStart[i]] - firstColumn[i];
+        glm::dvec3 value = work[i];
+        for (GLuint j = firstColumn[i]; j < i; j++)
+            value -= rowI[j] * work[j];
+        work[i] = value / rowI[i];
+    }
+
+    // L^T x = y, column by column from the last
+    for (GLuint i = count; i-- > 0;) {
+        const double* rowI = &values[rowStart[i]] - firstColumn[i];
+        glm::dvec3 value = work[i] / rowI[i];
+        work[i] = value;
+        for (GLuint j = firstColumn[i]; j < i; j++)
+            work[j] -= rowI[j] * value;
+    }
+
+    for (GLuint i = 0; i < count; i++)
+        x[order[i]] = glm::vec3(work[i]);
+}
+
+GLuint SparseCholesky::getUnknownCount() {
+    return count;
+}
+
+size_t SparseCholesky::getFactorSize() {
+    return values.size();
+}
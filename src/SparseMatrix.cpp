@@ -0,0 +1,275 @@
+#include "SparseMatrix.h"
+
+#include <algorithm>
+
+SparseMatrix::SparseMatrix() : rowCount(0), columnCount(0), rowStart(1, 0) {}
+
+SparseMatrix SparseMatrix::fromEntries(GLuint rowCount, GLuint columnCount, std::vector<MatrixEntry> entries) {
+    std::sort(entries.begin(), entries.end(), [](const MatrixEntry& a, const MatrixEntry& b) {
+        return a.row < b.row || (a.row == b.row && a.column < b.column);
+    });
+
+    SparseMatrix matrix;
+    matrix.rowCount = rowCount;
+    matrix.columnCount = columnCount;
+    matrix.rowStart.assign(rowCount + 1, 0);
+    for (size_t e = 0; e < entries.size(); e++) {
+        const MatrixEntry& entry = entries[e];
+        if (e > 0 && entry.row == entries[e - 1].row && entry.column == entries[e - 1].column) {
+            matrix.values.back() += entry.value;
+            continue;
+        }
+        matrix.columns.push_back(entry.column);
+        matrix.values.push_back(entry.value);
+        matrix.rowStart[entry.row + 1]++;
+    }
+    for (GLuint r = 0; r < rowCount; r++)
+        matrix.rowStart[r + 1] += matrix.rowStart[r];
+    return matrix;
+}
+
+SparseMatrix SparseMatrix::fromOrderedEntries(GLuint rowCount, GLuint columnCount,
+                                              const std::vector<MatrixEntry>& entries) {
+    // The entries of every row in the order given, by a counting sort over the rows
+    std::vector<GLuint> start(rowCount + 1, 0);
+    for (size_t e = 0; e < entries.size(); e++)
+        start[entries[e].row + 1]++;
+    for (GLuint r = 0; r < rowCount; r++)
+        start[r + 1] += start[r];
+    std::vector<GLuint> order(entries.size());
+    std::vector<GLuint> filled(start.begin(), start.end() - 1);
+    for (size_t e = 0; e < entries.size(); e++)
+        order[filled[entries[e].row]++] = (GLuint)e;
+
+    SparseMatrix matrix;
+    matrix.rowCount = rowCount;
+    matrix.columnCount = columnCount;
+    matrix.rowStart.assign(rowCount + 1, 0);
+
+    // One dense row at a time, with the list of its columns in use
+    std::vector<double> row(columnCount, 0.0);
+    std::vector<bool> used(columnCount, false);
+    std::vector<GLuint> usedColumns;
+    for (GLuint r = 0; r < rowCount; r++) {
+        usedColumns.clear();
+        for (GLuint n = start[r]; n < start[r + 1]; n++) {
+            const MatrixEntry& entry = entries[order[n]];
+            if (!used[entry.column]) {
+                used[entry.column] = true;
+                usedColumns.push_back(entry.column);
+            }
+            row[entry.column] += entry.value;
+        }
+
+        std::sort(usedColumns.begin(), usedColumns.end());
+        for (size_t i = 0; i < usedColumns.size(); i++) {
+            GLuint c = usedColumns[i];
+            matrix.columns.push_back(c);
+            matrix.values.push_back(GLfloat(row[c]));
+            row[c] = 0.0;
+            used[c] = false;
+        }
+        matrix.rowStart[r + 1] = (GLuint)matrix.columns.size();
+    }
+    return matrix;
+}
+
+SparseMatrix SparseMatrix::transpose() const {
+    SparseMatrix result;
+    result.rowCount = columnCount;
+    result.columnCount = rowCount;
+    result.rowStart.assign(columnCount + 1, 0);
+    result.columns.resize(columns.size());
+    result.values.resize(values.size());
+
+    for (size_t n = 0; n < columns.size(); n++)
+        result.rowStart[columns[n] + 1]++;
+    for (GLuint c = 0; c < columnCount; c++)
+        result.rowStart[c + 1] += result.rowStart[c];
+
+    // Going through the rows in order keeps the columns of every transposed row ascending
+    std::vector<GLuint> filled(result.rowStart.begin(), result.rowStart.end() - 1);
+    for (GLuint r = 0; r < rowCount; r++) {
+        for (GLuint n = rowStart[r]; n < rowStart[r + 1]; n++) {
+            GLuint at = filled[columns[n]]++;
+            result.columns[at] = r;
+            result.values[at] = values[n];
+        }
+    }
+    return result;
+}
+
+SparseMatrix SparseMatrix::multiply(const SparseMatrix& other) const {
+    SparseMatrix result;
+    result.rowCount = rowCount;
+    result.columnCount = other.columnCount;
+    result.rowStart.assign(rowCount + 1, 0);
+
+    // One dense row of the result at a time, with the list of its columns in use
+    std::vector<GLfloat> row(other.columnCount, 0.0f);
+    std::vector<bool> used(other.columnCount, false);
+    std::vector<GLuint> usedColumns;
+    for (GLuint r = 0; r < rowCount; r++) {
+        usedColumns.clear();
+        for (GLuint n = rowStart[r]; n < rowStart[r + 1]; n++) {
+            GLuint k = columns[n];
+            for (GLuint m = other.rowStart[k]; m < other.rowStart[k + 1]; m++) {
+                GLuint c = other.columns[m];
+                if (!used[c]) {
+                    used[c] = true;
+                    usedColumns.push_back(c);
+                }
+                row[c] += values[n] * other.values[m];
+            }
+        }
+
+        std::sort(usedColumns.begin(), usedColumns.end());
+        for (size_t i = 0; i < usedColumns.size(); i++) {
+            GLuint c = usedColumns[i];
+            result.columns.push_back(c);
+            result.values.push_back(row[c]);
+            row[c] = 0.0f;
+            used[c] = false;
+        }
+        result.rowStart[r + 1] = (GLuint)result.columns.size();
+    }
+    return result;
+}
+
+GLfloat SparseMatrix::get(GLuint row, GLuint column) const {
+    const GLuint* first = columns.data() + rowStart[row];
+    const GLuint* last = columns.data() + rowStart[row + 1];
+    const GLuint* found = std::lower_bound(first, last, column);
+    return found != last && *found == column ? values[found - columns.data()] : 0.0f;
+}
+
+void SparseMatrix::multiply(const glm::vec3* x, glm::vec3* y, GLuint begin, GLuint end) const {
+    for (GLuint r = begin; r < end; r++) {
+        glm::vec3 sum(0.0f, 0.0f, 0.0f);
+        for (GLuint n = rowStart[r]; n < rowStart[r + 1]; n++)
+            sum += values[n] * x[columns[n]];
+        y[r] = sum;
+    }
+}
+
+GLuint SparseMatrix::getNonZeroCount() const {
+    return (GLuint)columns.size();
+}
+
+SlicedMatrix::SlicedMatrix() : rowCount(0), sliceStart(1, 0), entryCount(0) {}
+
+SlicedMatrix::SlicedMatrix(const SparseMatrix& matrix, const std::vector<GLuint>& renumbering)
+        : rowCount(matrix.rowCount), entryCount(0) {
+    // The row of matrix every row of this one comes from
+    std::vector<GLuint> source(rowCount);
+    for (GLuint r = 0; r < rowCount; r++)
+        source[renumbering.empty() ? r : renumbering[r]] = r;
+
+    GLuint sliceCount = (rowCount + SLICE_ROWS - 1) / SLICE_ROWS;
+    std::vector<GLuint> lengths(rowCount, 0);
+    sliceStart.assign(sliceCount + 1, 0);
+    for (GLuint slice = 0; slice < sliceCount; slice++) {
+        GLuint width = 0;
+        for (GLuint r = slice * SLICE_ROWS; r < std::min((slice + 1) * SLICE_ROWS, rowCount); r++) {
+            for (GLuint n = matrix.rowStart[source[r]]; n < matrix.rowStart[source[r] + 1]; n++)
+                lengths[r] += matrix.columns[n] != source[r] ? 1 : 0;
+            width = std::max(width, lengths[r]);
+            entryCount += lengths[r];
+        }
+        sliceStart[slice + 1] = sliceStart[slice] + width * SLICE_ROWS;
+    }
+
+    // Padding refers to the row itself, or the last row past the end, with a value of zero
+    columns.resize(sliceStart.back());
+    values.assign(sliceStart.back(), 0.0f);
+    for (GLuint slice = 0; slice < sliceCount; slice++) {
+        GLuint width = (sliceStart[slice + 1] - sliceStart[slice]) / SLICE_ROWS;
+        for (GLuint i = 0; i < SLICE_ROWS; i++) {
+            GLuint r = std::min(slice * SLICE_ROWS + i, rowCount - 1);
+            GLuint at = sliceStart[slice] + i;
+            for (GLuint k = 0; k < width; k++)
+                columns[at + k * SLICE_ROWS] = r;
+            if (slice * SLICE_ROWS + i >= rowCount)
+                continue;
+            for (GLuint n = matrix.rowStart[source[r]]; n < matrix.rowStart[source[r] + 1]; n++) {
+                GLuint column = matrix.columns[n];
+                if (column == source[r])
+                    continue;
+                columns[at] = renumbering.empty() ? column : renumbering[column];
+                values[at] = matrix.values[n];
+                at += SLICE_ROWS;
+            }
+        }
+    }
+}
+
+GLuint SlicedMatrix::firstEntry(GLuint row) const {
+    return sliceStart[(row + SLICE_ROWS - 1) / SLICE_ROWS];
+}
+
+template <typename Real, typename Sum>
+void SlicedMatrix::multiply(const Real* x, const Real* y, const Real* z, Real* productX, Real* productY,
+                            Real* productZ, GLuint begin, GLuint end) const {
+    for (GLuint first = begin; first < end; first += SLICE_ROWS) {
+        GLuint slice = first / SLICE_ROWS;
+        Real ownX[SLICE_ROWS], ownY[SLICE_ROWS], ownZ[SLICE_ROWS];
+        Sum sumX[SLICE_ROWS], sumY[SLICE_ROWS], sumZ[SLICE_ROWS];
+        for (GLuint i = 0; i < SLICE_ROWS; i++) {
+            GLuint r = std::min(first + i, rowCount - 1);
+            ownX[i] = x[r];
+            ownY[i] = y[r];
+            ownZ[i] = z[r];
+            sumX[i] = sumY[i] = sumZ[i] = 0.0f;
+        }
+
+        const GLuint* column = columns.data() + sliceStart[slice];
+        const GLfloat* value = values.data() + sliceStart[slice];
+        const GLuint* last = columns.data() + sliceStart[slice + 1];
+        for (; column < last; column += SLICE_ROWS, value += SLICE_ROWS) {
+            for (GLuint i = 0; i < SLICE_ROWS; i++) {
+                Sum a = value[i];
+                sumX[i] += a * Sum(x[column[i]] - ownX[i]);
+                sumY[i] += a * Sum(y[column[i]] - ownY[i]);
+                sumZ[i] += a * Sum(z[column[i]] - ownZ[i]);
+            }
+        }
+
+        for (GLuint i = 0; i < SLICE_ROWS && first + i < end; i++) {
+            productX[first + i] = Real(sumX[i]);
+            productY[first + i] = Real(sumY[i]);
+            productZ[first + i] = Real(sumZ[i]);
+        }
+    }
+}
+
+template <typename Real, typename Sum>
+Sum SlicedMatrix::quadraticForm(const Real* x, const Real* y, const Real* z, GLuint begin, GLuint end) const {
+    Sum form = 0.0f;
+    for (GLuint first = begin; first < end; first += SLICE_ROWS) {
+        GLuint slice = first / SLICE_ROWS;
+        GLuint width = (sliceStart[slice + 1] - sliceStart[slice]) / SLICE_ROWS;
+        for (GLuint i = 0; i < SLICE_ROWS && first + i < end; i++) {
+            GLuint r = first + i;
+            for (GLuint k = 0; k < width; k++) {
+                GLuint at = sliceStart[slice] + k * SLICE_ROWS + i;
+                Sum dx = x[columns[at]] - x[r], dy = y[columns[at]] - y[r], dz = z[columns[at]] - z[r];
+                form -= Sum(0.5f) * Sum(values[at]) * (dx * dx + dy * dy + dz * dz);
+            }
+        }
+    }
+    return form;
+}
+
+// The precisions of BasicWorld
+template void SlicedMatrix::multiply<GLfloat, GLfloat>(const GLfloat*, const GLfloat*, const GLfloat*, GLfloat*,
+                                                       GLfloat*, GLfloat*, GLuint, GLuint) const;
+template void SlicedMatrix::multiply<GLdouble, GLdouble>(const GLdouble*, const GLdouble*, const GLdouble*, GLdouble*,
+                                                         GLdouble*, GLdouble*, GLuint, GLuint) const;
+template void SlicedMatrix::multiply<GLfloat, GLdouble>(const GLfloat*, const GLfloat*, const GLfloat*, GLfloat*,
+                                                        GLfloat*, GLfloat*, GLuint, GLuint) const;
+template GLfloat SlicedMatrix::quadraticForm<GLfloat, GLfloat>(const GLfloat*, const GLfloat*, const GLfloat*,
+                                                               GLuint, GLuint) const;
+template GLdouble SlicedMatrix::quadraticForm<GLdouble, GLdouble>(const GLdouble*, const GLdouble*, const GLdouble*,
+                                                                  GLuint, GLuint) const;
+template GLdouble SlicedMatrix::quadraticForm<GLfloat, GLdouble>(const GLfloat*, const GLfloat*, const GLfloat*,
+                                                                 GLuint, GLuint) const;
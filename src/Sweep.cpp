@@ -0,0 +1,187 @@
+#include "Sweep.h"
+#include "World.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// Removes leading and trailing white space
+static std::string trim(std::string text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+static bool parseList(std::string value, std::vector<GLfloat>& list) {
+    std::istringstream stream(value);
+    GLfloat number;
+    list.clear();
+    while (stream >> number)
+        list.push_back(number);
+    return stream.eof() && !list.empty();
+}
+
+Sweep::Sweep() {
+    time = 10.0f;
+}
+
+bool Sweep::load(std::string fileName) {
+    std::ifstream file(fileName.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open sweep " << fileName << std::endl;
+        return false;
+    }
+
+    // Scene and output paths are relative to the sweep file
+    std::string directory;
+    size_t slash = fileName.find_last_of("/\\");
+    if (slash != std::string::npos)
+        directory = fileName.substr(0, slash + 1);
+
+    bool ok = true;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+        line = trim(line);
+        if (line.empty() || line == "[sweep]")
+            continue;
+
+        size_t equals = line.find('=');
+        std::string key = trim(line.substr(0, equals));
+        std::string value = equals == std::string::npos ? "" : trim(line.substr(equals + 1));
+        bool valid = equals != std::string::npos;
+
+        if (valid && key == "scene")
+            valid = scene.load(directory + value);
+        else if (valid && key == "output")
+            output = directory + value;
+        else if (valid && key == "time")
+            valid = std::istringstream(value) >> time && time > 0.0f;
+        else if (valid && key == "k")
+            valid = parseList(value, kValues);
+        else if (valid && key == "b")
+            valid = parseList(value, bValues);
+        else if (valid && key == "h")
+            valid = parseList(value, hValues);
+        else
+            valid = false;
+
+        if (!valid) {
+            std::cerr << fileName << ":" << lineNumber << ": invalid line " << line << std::endl;
+            ok = false;
+        }
+    }
+
+    if (kValues.empty())
+        kValues.push_back(scene.material.k);
+    if (bValues.empty())
+        bValues.push_back(scene.material.b);
+    if (hValues.empty())
+        hValues.push_back(scene.solver.h);
+    return ok;
+}
+
+void Sweep::run(GLuint threadCount) {
+    results.clear();
+    for (GLuint i = 0; i < kValues.size(); i++) {
+        for (GLuint j = 0; j < bValues.size(); j++) {
+            for (GLuint l = 0; l < hValues.size(); l++) {
+                SweepResult result;
+                result.k = kValues[i];
+                result.b = bValues[j];
+                result.h = hValues[l];
+                results.push_back(result);
+            }
+        }
+    }
+
+    ThreadPool pool(threadCount);
+    std::cout << "Sweeping " << results.size() << " configurations of " << scene.name
+              << " on " << pool.getThreadCount() << " threads" << std::endl;
+
+    // Every task writes only its own result, so the results need no locking
+    for (GLuint r = 0; r < results.size(); r++) {
+        SweepResult* result = &results[r];
+        Scene configuration = scene;
+        configuration.material.k = result->k;
+        configuration.material.b = result->b;
+        configuration.solver.h = result->h;
+        GLfloat runTime = time;
+        pool.submit([configuration, runTime, result] { simulate(configuration, runTime, *result); });
+    }
+    pool.wait();
+}
+
+void Sweep::simulate(Scene scene, GLfloat time, SweepResult& result) {
+    PROFILE_SCOPE(PHASE_SIMULATE);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<World> world = World::create(scene);
+    GLuint frames = (GLuint)std::ceil(time / world->getFrameTime());
+
+    GLfloat limit = world->getEnergyScale();
+    GLfloat startEnergy = world->getEnergy();
+    result.stable = true;
+    result.energyGain = 0.0f;
+    result.steps = 0;
+
+    for (GLuint f = 0; f < frames && result.stable; f++) {
+        world->step(false);
+        result.steps += scene.solver.substeps;
+
+        GLfloat gain = (world->getEnergy() - startEnergy) / limit;
+        if (!std::isfinite(gain) || gain > 1.0f)
+            result.stable = false;
+        if (!(gain <= result.energyGain))
+            result.energyGain = gain;
+    }
+
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Sweep::report(std::ostream& out) {
+    out << std::setw(10) << "k" << std::setw(10) << "b" << std::setw(10) << "h"
+        << std::setw(10) << "stable" << std::setw(10) << "steps" << std::setw(14) << "energy gain"
+        << std::setw(12) << "ms" << std::setw(12) << "us/step" << std::endl;
+
+    for (GLuint r = 0; r < results.size(); r++) {
+        const SweepResult& result = results[r];
+        out << std::setw(10) << result.k << std::setw(10) << result.b << std::setw(10) << result.h
+            << std::setw(10) << (result.stable ? "yes" : "NO") << std::setw(10) << result.steps
+            << std::setw(14) << result.energyGain << std::setw(12) << std::fixed << std::setprecision(1)
+            << result.milliseconds << std::setw(12) << 1000.0 * result.milliseconds / std::max(result.steps, 1u)
+            << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+bool Sweep::writeCsv() {
+    if (output.empty())
+        return true;
+
+    std::ofstream file(output.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << output << std::endl;
+        return false;
+    }
+
+    file << "k,b,h,stable,steps,energyGain,milliseconds" << std::endl;
+    for (GLuint r = 0; r < results.size(); r++) {
+        const SweepResult& result = results[r];
+        file << result.k << "," << result.b << "," << result.h << "," << (result.stable ? 1 : 0) << ","
+             << result.steps << "," << result.energyGain << "," << result.milliseconds << std::endl;
+    }
+    std::cout << "Wrote " << output << std::endl;
+    return file.good();
+}
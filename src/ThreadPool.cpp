@@ -0,0 +1,242 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+// Index of the pool queue owned by the current thread, or -1 outside of a pool
+static thread_local int ownQueue = -1;
+static thread_local const ThreadPool* ownPool = nullptr;
+
+ThreadPool::ThreadPool(GLuint threadCount) : partitionCount(1), nextQueue(0), queued(0), unfinished(0),
+                                             stopping(false), started(0), loopWork(nullptr), loopCount(0),
+                                             loopBlockSize(1), loopStealing(true), loopRunning(0), loopLeft(0),
+                                             loopOpen(0) {
+    start(threadCount);
+}
+
+ThreadPool::ThreadPool(GLuint threadCount, const NumaTopology& topology)
+        : partitionCount(1), nextQueue(0), queued(0), unfinished(0), stopping(false), started(0), loopWork(nullptr),
+          loopCount(0), loopBlockSize(1), loopStealing(true), loopRunning(0), loopLeft(0), loopOpen(0) {
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Contiguous groups of workers per node, so the partitions of a loop follow the node order
+    partitionCount = std::min(std::min(topology.getNodeCount(), threadCount), MAX_PARTITIONS);
+    for (GLuint i = 0; i < threadCount; i++) {
+        GLuint node = i * partitionCount / threadCount;
+        workerPartition.push_back(node);
+        workerCpus.push_back(topology.getCpus(node));
+    }
+    start(threadCount);
+}
+
+// Creates the queues and workers and waits until every worker has started
+void ThreadPool::start(GLuint threadCount) {
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+
+    workerPartition.resize(threadCount, 0);
+    partitionNext.resize(partitionCount);
+    partitionEnd.resize(partitionCount);
+
+    for (GLuint i = 0; i < threadCount; i++)
+        queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+    for (GLuint i = 0; i < threadCount; i++)
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+
+    // Once this returns the workers are running and have done their start-up work
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    allDone.wait(lock, [this, threadCount] { return started == threadCount; });
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    taskAdded.notify_all();
+    for (GLuint i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    // Workers keep their own tasks local, everyone else spreads them out
+    GLuint queue = ownPool == this ? (GLuint)ownQueue : nextQueue++ % (GLuint)queues.size();
+
+    unfinished++;
+    {
+        // Counted under the sleep lock so a worker about to sleep cannot miss it
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+        queues[queue]->tasks.push_back(std::move(task));
+    }
+    taskAdded.notify_one();
+}
+
+void ThreadPool::parallelFor(GLuint count, GLuint blockSize, BlockFunction work, bool stealing) {
+    if (count <= blockSize && (stealing || partitionCount == 1)) {
+        if (count > 0)
+            work(0, count);
+        return;
+    }
+
+    GLuint blocks = (count + blockSize - 1) / blockSize;
+    uint64_t open = 0;
+    {
+        std::lock_guard<std::mutex> lock(loopMutex);
+        loopWork = &work;
+        loopCount = count;
+        loopBlockSize = blockSize;
+        loopStealing = stealing;
+        loopRunning = 0;
+        loopLeft = blocks;
+        for (GLuint p = 0; p < partitionCount; p++) {
+            partitionNext[p] = (GLuint)((uint64_t)blocks * p / partitionCount);
+            partitionEnd[p] = (GLuint)((uint64_t)blocks * (p + 1) / partitionCount);
+            if (partitionNext[p] < partitionEnd[p])
+                open |= (uint64_t)1 << p;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        loopOpen = open;
+    }
+    taskAdded.notify_all();
+
+    // Help with the blocks, then wait for the ones still running on workers
+    if (stealing) {
+        while (runLoopBlock(partitionCount)) {}
+    }
+    std::unique_lock<std::mutex> lock(loopMutex);
+    loopFinished.wait(lock, [this] { return loopRunning == 0 && loopLeft == 0; });
+    loopWork = nullptr;
+}
+
+// Whether a thread of partition, or partitionCount for the calling thread, can claim a block
+bool ThreadPool::canClaim(GLuint partition) {
+    uint64_t open = loopOpen;
+    if (partition < partitionCount && (open >> partition & 1))
+        return true;
+    return loopStealing && open != 0;
+}
+
+// Claims and runs the next block of the running parallelFor, false if there is none. A thread
+// takes the blocks of its own partition first, then those of the following ones.
+bool ThreadPool::runLoopBlock(GLuint partition) {
+    const BlockFunction* work;
+    GLuint begin, end;
+    {
+        std::lock_guard<std::mutex> lock(loopMutex);
+        if (loopWork == nullptr || loopLeft == 0)
+            return false;
+
+        GLuint from = partitionCount;
+        if (partition < partitionCount && partitionNext[partition] < partitionEnd[partition])
+            from = partition;
+        for (GLuint i = 0; loopStealing && from == partitionCount && i < partitionCount; i++) {
+            GLuint other = (partition + i) % partitionCount;
+            if (partitionNext[other] < partitionEnd[other])
+                from = other;
+        }
+        if (from == partitionCount)
+            return false;
+
+        GLuint block = partitionNext[from]++;
+        work = loopWork;
+        begin = block * loopBlockSize;
+        end = std::min(begin + loopBlockSize, loopCount);
+        loopRunning++;
+        loopLeft--;
+        if (partitionNext[from] == partitionEnd[from])
+            loopOpen &= ~((uint64_t)1 << from);
+    }
+
+    (*work)(begin, end);
+
+    std::lock_guard<std::mutex> lock(loopMutex);
+    if (--loopRunning == 0 && loopLeft == 0)
+        loopFinished.notify_all();
+    return true;
+}
+
+void ThreadPool::wait() {
+    GLuint self = ownPool == this ? (GLuint)ownQueue : 0;
+    while (unfinished > 0) {
+        if (!runTask(self)) {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            allDone.wait(lock, [this] { return unfinished == 0; });
+        }
+    }
+}
+
+GLuint ThreadPool::getThreadCount() {
+    return (GLuint)threads.size();
+}
+
+GLuint ThreadPool::getPartitionCount() {
+    return partitionCount;
+}
+
+void ThreadPool::workerLoop(GLuint self) {
+    ownQueue = (int)self;
+    ownPool = this;
+    PROFILE_THREAD_NAME("worker " + std::to_string(self));
+    if (self < workerCpus.size())
+        NumaTopology::pinThread(workerCpus[self]);
+    GLuint partition = workerPartition[self];
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        started++;
+    }
+    allDone.notify_all();
+
+    while (true) {
+        if (runLoopBlock(partition) || runTask(self))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        taskAdded.wait(lock, [this, partition] { return stopping || queued > 0 || canClaim(partition); });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+bool ThreadPool::runTask(GLuint self) {
+    std::function<void()> task;
+
+    // Newest task of the own queue first, it is the most likely to still be in the cache
+    {
+        std::lock_guard<std::mutex> lock(queues[self]->mutex);
+        if (!queues[self]->tasks.empty()) {
+            task = std::move(queues[self]->tasks.back());
+            queues[self]->tasks.pop_back();
+        }
+    }
+
+    // Otherwise steal the oldest task of another queue
+    for (GLuint i = 1; !task && i < queues.size(); i++) {
+        TaskQueue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+        return false;
+
+    queued--;
+    task();
+    if (--unfinished == 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        allDone.notify_all();
+    }
+    return true;
+}
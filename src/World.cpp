@@ -0,0 +1,1949 @@
+#include "World.h"
+#include "BasicWorld.h"
+#include "ClothMesh.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
+#include <functional>
+
+// GLM
+#include <gtc/noise.hpp>
+#include <gtc/constants.hpp>
+
+template <typename Real>
+static glm::tvec3<Real, glm::highp> theSpringForce(glm::tvec3<Real, glm::highp> p1, glm::tvec3<Real, glm::highp> p2,
+                                                   Real L0, Real k);
+template <typename Real>
+static glm::tvec3<Real, glm::highp> theDampForce(glm::tvec3<Real, glm::highp> v1, glm::tvec3<Real, glm::highp> v2, Real b);
+template <typename Real>
+static glm::tvec3<Real, glm::highp> RungeKuttaForVel(glm::tvec3<Real, glm::highp> velocity,
+                                                     glm::tvec3<Real, glm::highp> acceleration, Real h);
+template <typename Real>
+static glm::tvec3<Real, glm::highp> RungeKuttaForPosDiff(glm::tvec3<Real, glm::highp> velocity, Real h);
+template <typename Real>
+static void aerodynamicForces(GLuint begin, GLuint end, const Real* e1x, const Real* e1y, const Real* e1z,
+                              const Real* e2x, const Real* e2y, const Real* e2z,
+                              const Real* rx, const Real* ry, const Real* rz,
+                              Real dragFactor, Real liftFactor, Real* fx, Real* fy, Real* fz);
+
+// Sorts particles or springs, the item, by a code and then by the item
+struct OrderKey {
+    uint64_t code;
+    GLuint item;
+
+    bool operator<(const OrderKey& other) const {
+        return code < other.code || (code == other.code && item < other.item);
+    }
+};
+
+template <typename Real, typename Sum>
+BasicWorld<Real, Sum>::BasicWorld(const Scene& theScene) : pool(nullptr), time(0.0f), orderedCount(0), iterations(0), forcesValid(false), forcesPush(false) {
+    scene = theScene;
+    build(0);
+}
+
+template <typename Real, typename Sum>
+BasicWorld<Real, Sum>::BasicWorld(const Scene& theScene, GLuint firstRow, GLuint rowCount)
+        : pool(nullptr), time(0.0f), orderedCount(0), iterations(0), forcesValid(false), forcesPush(false) {
+    scene = theScene;
+
+    // The band becomes a cloth of its own, with the pins and the pushed particle of its rows
+    ClothSettings& settings = scene.cloths[0];
+    GLuint pushRow = settings.height / 2 - 1, pushColumn = settings.width / 2 - 1;
+    std::vector<Pin> pins;
+    for (GLuint p = 0; p < settings.pins.size(); p++) {
+        Pin pin = settings.pins[p];
+        if (pin.row >= firstRow && pin.row < firstRow + rowCount) {
+            pin.row -= firstRow;
+            pins.push_back(pin);
+        }
+    }
+    settings.pins = pins;
+    settings.height = rowCount;
+    build(firstRow);
+
+    std::fill(pushed.begin(), pushed.end(), 0);
+    if (pushRow >= firstRow && pushRow < firstRow + rowCount)
+        pushed[particleIndex((pushRow - firstRow) * settings.width + pushColumn)] = 1;
+}
+
+// Creates the cloths of the scene, the rows of every cloth numbered from firstRow
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::build(GLuint firstRow) {
+    // Every copy of every cloth of the scene becomes a cloth of the world, the arrays are sized
+    // for all of them up front
+    GLuint particleTotal = 0, springTotal = 0, triangleTotal = 0, clothTotal = 0;
+    for (GLuint c = 0; c < scene.cloths.size(); c++) {
+        const ClothSettings& settings = scene.cloths[c];
+        GLuint copies = settings.copiesX * settings.copiesZ;
+        GLuint w = settings.width, h = settings.height;
+        clothTotal += copies;
+        particleTotal += copies * w * h;
+        if (settings.mesh) {
+            springTotal += copies * (GLuint)settings.mesh->springs.size();
+            triangleTotal += copies * (GLuint)settings.mesh->indices.size() / 3;
+        } else {
+            springTotal += copies * (h * (w - 2) + (h - 2) * w + 2 * (h - 1) * (w - 1) + h * (w - 1) + (h - 1) * w);
+            triangleTotal += copies * 2 * (h - 1) * (w - 1);
+        }
+    }
+    cloths.reserve(clothTotal);
+    positions.reserve(particleTotal);
+    velocities.reserve(particleTotal);
+    accelerations.reserve(particleTotal);
+    masses.reserve(particleTotal);
+    inverseMasses.reserve(particleTotal);
+    pinned.reserve(particleTotal);
+    pushed.reserve(particleTotal);
+    vertexSpringStart.reserve(particleTotal);
+    vertexSpringCount.reserve(particleTotal);
+    vertexSprings.reserve(2 * springTotal);
+    springs.reserve(springTotal);
+    indices.reserve(3 * triangleTotal);
+
+    // Quantised rest lengths are 16 bits over the longest spring of any cloth, a bend spring of two
+    // rest lengths in a grid. That only depends on the scene, so a band quantises as the whole cloth does.
+    lengthQuantum = 0.0f;
+    restLengthError = 0.0f;
+    if (scene.solver.quantisedRestLengths) {
+        for (GLuint c = 0; c < scene.cloths.size(); c++) {
+            const ClothSettings& settings = scene.cloths[c];
+            Real longest = settings.mesh ? Real(settings.mesh->longestSpring) : Real(2) * settings.restLength;
+            lengthQuantum = std::max(lengthQuantum, longest / Real(UINT16_MAX));
+        }
+    } else {
+        restLengths.reserve(springTotal);
+    }
+
+    windForces.reserve(particleTotal);
+
+    springCount = 0;
+    energyScale = 0.0f;
+    for (GLuint c = 0; c < scene.cloths.size(); c++) {
+        const ClothSettings& settings = scene.cloths[c];
+        materials.push_back(scene.getMaterial(c));
+        for (GLuint z = 0; z < settings.copiesZ; z++) {
+            for (GLuint x = 0; x < settings.copiesX; x++) {
+                glm::vec3 corner = settings.corner + glm::vec3(x * settings.spacingX, 0.0f, z * settings.spacingZ);
+                if (settings.mesh)
+                    addMesh(settings, c, corner);
+                else
+                    addCloth(settings, c, corner, firstRow);
+            }
+        }
+    }
+    if (energyScale <= 0.0f)
+        energyScale = 1.0f;
+
+    GLuint particleCount = (GLuint)positions.size();
+    GLuint springBlocks = ((GLuint)springs.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    springForces.resize(springs.size());
+    dampForces.resize(springs.size());
+
+    // Lists the triangles of every vertex, in triangle order
+    GLuint triangleCount = (GLuint)indices.size() / 3;
+    vertexTriangleCount.assign(particleCount, 0);
+    for (GLuint v = 0; v < indices.size(); v++)
+        vertexTriangleCount[indices[v]]++;
+    vertexTriangleStart.assign(particleCount, 0);
+    for (GLuint p = 1; p < particleCount; p++)
+        vertexTriangleStart[p] = vertexTriangleStart[p - 1] + vertexTriangleCount[p - 1];
+    vertexTriangles.resize(indices.size());
+    std::vector<GLuint> filled(vertexTriangleStart.begin(), vertexTriangleStart.end());
+    for (GLuint t = 0; t < triangleCount; t++) {
+        for (GLuint v = 0; v < 3; v++)
+            vertexTriangles[filled[indices[3 * t + v]]++] = t;
+    }
+    triangleChanged.assign(triangleCount, false);
+
+    // The quadratic form of the bending energy is summed per block of particles
+    bool bending = scene.solver.bending == BENDING_QUADRATIC;
+    GLuint bendBlocks = bending ? (particleCount + BLOCK_SIZE - 1) / BLOCK_SIZE : 0;
+
+    // Tearing gives every corner of a triangle at most a particle of its own, the particle arrays
+    // get room for that many so splitting never has to grow them
+    bool tears = false;
+    for (GLuint m = 0; m < materials.size(); m++)
+        tears = tears || materials[m].tearStrain > 0.0f;
+    GLuint particleBound = particleCount;
+    if (tears) {
+        tornSprings.resize(springBlocks * BLOCK_SIZE);
+        tornCounts.assign(springBlocks, 0);
+        changedTriangles.reserve(triangleCount);
+        particleBound += 3 * triangleCount;
+        positions.reserve(particleBound);
+        velocities.reserve(particleBound);
+        accelerations.reserve(particleBound);
+        masses.reserve(particleBound);
+        inverseMasses.reserve(particleBound);
+        pinned.reserve(particleBound);
+        pushed.reserve(particleBound);
+        windForces.reserve(particleBound);
+        vertexSpringStart.reserve(particleBound);
+        vertexSpringCount.reserve(particleBound);
+        vertexTriangleStart.reserve(particleBound);
+        vertexTriangleCount.reserve(particleBound);
+    }
+
+    // Scratch of a step and of the queries after it: the per block energies and, with tearing,
+    // the particles of the torn springs and the lists of one split
+    GLuint mostTriangles = 0, mostSprings = 0;
+    for (GLuint p = 0; p < particleCount; p++) {
+        mostTriangles = std::max(mostTriangles, vertexTriangleCount[p]);
+        mostSprings = std::max(mostSprings, vertexSpringCount[p]);
+    }
+    size_t scratchBytes = ((particleBound + BLOCK_SIZE - 1) / BLOCK_SIZE + springBlocks + bendBlocks) * sizeof(Sum);
+    if (tears)
+        scratchBytes += (2 * springs.size() + 2 * (mostTriangles + mostSprings)) * sizeof(GLuint);
+    bool ordered = scene.solver.particleOrder == ORDER_MORTON;
+    if (ordered) {
+        // The keys and moves of the particles and springs and one array of either while it is
+        // being permuted, as the particles tearing adds are put in order
+        size_t permuted = std::max(std::max(particleBound * sizeof(Vec3), springs.size() * sizeof(Spring)),
+                                   std::max(vertexSprings.size(), vertexTriangles.size()) * sizeof(GLuint));
+        scratchBytes += (particleBound + springs.size()) * (sizeof(OrderKey) + sizeof(GLuint)) + permuted + 3 * 64;
+    }
+    scratch.reserve(scratchBytes + 64);
+
+    // The particles are numbered in grid order before they are put in Morton order
+    if (ordered) {
+        particleNumbers.reserve(particleBound);
+        particleIndices.reserve(particleBound);
+        for (GLuint p = 0; p < particleCount; p++) {
+            particleNumbers.push_back(p);
+            particleIndices.push_back(p);
+        }
+        numberedIndices = indices;
+        reorder();
+    }
+
+    // After the particles are in order, the bending matrix is assembled for their indices
+    if (bending)
+        buildBending();
+
+    if (scene.wind.type != WIND_NONE) {
+        edge1X.resize(triangleCount); edge1Y.resize(triangleCount); edge1Z.resize(triangleCount);
+        edge2X.resize(triangleCount); edge2Y.resize(triangleCount); edge2Z.resize(triangleCount);
+        relativeX.resize(triangleCount); relativeY.resize(triangleCount); relativeZ.resize(triangleCount);
+        aeroX.resize(triangleCount); aeroY.resize(triangleCount); aeroZ.resize(triangleCount);
+    }
+
+    if (scene.solver.adaptive) {
+        savedPositions.resize(particleCount);
+        savedVelocities.resize(particleCount);
+        savedAccelerations.resize(particleCount);
+        shortestRestLength = FLT_MAX;
+        for (GLuint s = 0; s < springs.size(); s++)
+            shortestRestLength = std::min(shortestRestLength, restLength(s));
+        adaptiveSize = scene.solver.h;
+    }
+
+    // Every particle relaxes its springs once in the search, that bounds the queue
+    if (scene.solver.tethers) {
+        tetherAnchors.reserve(particleBound);
+        tetherLengths.reserve(particleBound);
+        tetherQueue.reserve(particleBound + 2 * springs.size());
+        findTethers();
+    }
+
+    if (scene.solver.method == SOLVER_IMPLICIT)
+        buildImplicit();
+    else if (scene.solver.method == SOLVER_PROJECTIVE)
+        buildProjective();
+}
+
+// Appends the particles, springs and triangles of one cloth with the particle of row 0, column 0
+// at corner. The rows of the cloth are rows firstRow and on of a larger grid.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::addCloth(const ClothSettings& settings, GLuint material, glm::vec3 corner, GLuint firstRow) {
+    GLuint clothWidth = settings.width;
+    GLuint clothHeight = settings.height;
+    Real L0 = settings.restLength;
+    Real L0cross = std::sqrt((Real)pow(L0,2)*2);
+    Real mass = materials[material].mass;
+
+    Cloth cloth;
+    cloth.width = clothWidth;
+    cloth.height = clothHeight;
+    cloth.firstParticle = (GLuint)positions.size();
+    cloth.firstSpring = (GLuint)springs.size();
+    cloth.firstTriangle = (GLuint)indices.size() / 3;
+    cloth.material = material;
+    GLuint base = cloth.firstParticle;
+
+    // Create all the particles and put them in a grid
+    for (GLuint i = 0; i < clothHeight; i++) {
+        for (GLuint j = 0; j < clothWidth; j++)
+            addParticle(Vec3(corner) + Vec3(j * L0, 0.0f, -(Real)(firstRow + i) * L0), Vec3(0.0f, 0.0f, 0.0f),
+                        mass, false);
+    }
+    for (GLuint p = 0; p < settings.pins.size(); p++)
+        pinned[base + settings.pins[p].row * clothWidth + settings.pins[p].column] = 1;
+    pushed[base + ((clothHeight / 2) - 1) * clothWidth + (clothWidth / 2) - 1] = 1;
+
+    // Structural, shear and bend springs of the grid, each going from a particle to its
+    // neighbour to the right or on the row above. Quadratic bending takes the place of the bend springs.
+    bool bendSprings = scene.solver.bending == BENDING_SPRINGS;
+    std::vector<GLuint> none(clothWidth * clothHeight, UINT32_MAX);
+    std::vector<GLuint> bendRight(none), bendUp(none), shearUpRight(none), shearUpLeft(none);
+    std::vector<GLuint> structuralRight(none), structuralUp(none);
+    for (GLuint i = 0; i < clothHeight; i++) {
+        for (GLuint j = 0; j < clothWidth; j++) {
+            GLuint q = i * clothWidth + j;
+            GLuint p = base + q;
+            if (bendSprings && j + 2 < clothWidth) {
+                bendRight[q] = (GLuint)springs.size();
+                addSpring(p, p + 2, Real(2) * L0, SPRING_BEND, material);
+            }
+            if (bendSprings && i >= 2) {
+                bendUp[q] = (GLuint)springs.size();
+                addSpring(p, p - 2 * clothWidth, Real(2) * L0, SPRING_BEND, material);
+            }
+            if (i >= 1 && j + 1 < clothWidth) {
+                shearUpRight[q] = (GLuint)springs.size();
+                addSpring(p, p - clothWidth + 1, L0cross, SPRING_SHEAR, material);
+            }
+            if (i >= 1 && j >= 1) {
+                shearUpLeft[q] = (GLuint)springs.size();
+                addSpring(p, p - clothWidth - 1, L0cross, SPRING_SHEAR, material);
+            }
+            if (j + 1 < clothWidth) {
+                structuralRight[q] = (GLuint)springs.size();
+                addSpring(p, p + 1, L0, SPRING_STRUCTURAL, material);
+            }
+            if (i >= 1) {
+                structuralUp[q] = (GLuint)springs.size();
+                addSpring(p, p - clothWidth, L0, SPRING_STRUCTURAL, material);
+            }
+        }
+    }
+    cloth.springCount = (GLuint)springs.size() - cloth.firstSpring;
+
+    // The springs of every particle, in the order the forces have always been summed in: bend,
+    // shear and structural, each right or up before left or down
+    for (GLuint i = 0; i < clothHeight; i++) {
+        for (GLuint j = 0; j < clothWidth; j++) {
+            GLuint q = i * clothWidth + j;
+            GLuint own[12] = {
+                    bendRight[q], bendUp[q],
+                    j >= 2 ? bendRight[q - 2] : UINT32_MAX,
+                    i + 2 < clothHeight ? bendUp[q + 2 * clothWidth] : UINT32_MAX,
+                    shearUpRight[q], shearUpLeft[q],
+                    i + 1 < clothHeight && j >= 1 ? shearUpRight[q + clothWidth - 1] : UINT32_MAX,
+                    i + 1 < clothHeight && j + 1 < clothWidth ? shearUpLeft[q + clothWidth + 1] : UINT32_MAX,
+                    structuralRight[q], structuralUp[q],
+                    j >= 1 ? structuralRight[q - 1] : UINT32_MAX,
+                    i + 1 < clothHeight ? structuralUp[q + clothWidth] : UINT32_MAX};
+
+            vertexSpringStart.push_back((GLuint)vertexSprings.size());
+            for (GLuint n = 0; n < 12; n++) {
+                if (own[n] != UINT32_MAX)
+                    vertexSprings.push_back(own[n]);
+            }
+            vertexSpringCount.push_back((GLuint)vertexSprings.size() - vertexSpringStart.back());
+        }
+    }
+
+    for (GLuint i = 0; i < clothHeight-1; i++) {
+        for (GLuint j = 0; j < clothWidth-1; j++) {
+            GLuint q = base + i * clothWidth + j;
+            indices.push_back(q);
+            indices.push_back(q + 1);
+            indices.push_back(q + clothWidth);
+            indices.push_back(q + 1);
+            indices.push_back(q + clothWidth + 1);
+            indices.push_back(q + clothWidth);
+        }
+    }
+    cloth.triangleCount = (GLuint)indices.size() / 3 - cloth.firstTriangle;
+
+    Real size = (clothWidth + clothHeight) * L0;
+    energyScale += (Real)(clothWidth * clothHeight) * mass * glm::length(scene.solver.gravity) * size;
+    cloths.push_back(cloth);
+}
+
+// Appends the particles, springs and triangles of a mesh cloth with the mesh's origin at corner.
+// The springs of every particle are in the order of the mesh's springs.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::addMesh(const ClothSettings& settings, GLuint material, glm::vec3 corner) {
+    const ClothMesh& mesh = *settings.mesh;
+    GLuint vertexCount = (GLuint)mesh.positions.size();
+    Real mass = materials[material].mass;
+
+    Cloth cloth;
+    cloth.width = vertexCount;
+    cloth.height = 1;
+    cloth.firstParticle = (GLuint)positions.size();
+    cloth.firstSpring = (GLuint)springs.size();
+    cloth.firstTriangle = (GLuint)indices.size() / 3;
+    cloth.material = material;
+    GLuint base = cloth.firstParticle;
+
+    for (GLuint v = 0; v < vertexCount; v++)
+        addParticle(Vec3(corner) + Vec3(mesh.positions[v]), Vec3(0.0f, 0.0f, 0.0f), mass, false);
+    for (GLuint p = 0; p < settings.pins.size(); p++)
+        pinned[base + settings.pins[p].column] = 1;
+    pushed[base + mesh.middle] = 1;
+
+    // The rest lengths are those of the mesh itself, the same for every copy. Quadratic bending
+    // takes the place of the bend springs.
+    GLuint listStart = (GLuint)vertexSprings.size();
+    std::vector<GLuint> filled(vertexCount, 0);
+    for (GLuint s = 0; s < mesh.springs.size(); s++) {
+        const ClothMesh::Spring& spring = mesh.springs[s];
+        if (spring.type == SPRING_BEND && scene.solver.bending != BENDING_SPRINGS)
+            continue;
+        Real length = glm::length(Vec3(mesh.positions[spring.b]) - Vec3(mesh.positions[spring.a]));
+        addSpring(base + spring.a, base + spring.b, length, spring.type, material);
+        filled[spring.a]++;
+        filled[spring.b]++;
+    }
+    cloth.springCount = (GLuint)springs.size() - cloth.firstSpring;
+
+    for (GLuint v = 0; v < vertexCount; v++) {
+        vertexSpringStart.push_back(listStart);
+        vertexSpringCount.push_back(filled[v]);
+        filled[v] = listStart;
+        listStart += vertexSpringCount.back();
+    }
+    vertexSprings.resize(listStart);
+    for (GLuint s = cloth.firstSpring; s < cloth.firstSpring + cloth.springCount; s++) {
+        vertexSprings[filled[springs[s].a - base]++] = s;
+        vertexSprings[filled[springs[s].b - base]++] = s;
+    }
+
+    for (GLuint i = 0; i < mesh.indices.size(); i++)
+        indices.push_back(base + mesh.indices[i]);
+    cloth.triangleCount = (GLuint)indices.size() / 3 - cloth.firstTriangle;
+
+    glm::vec3 extent = mesh.highest - mesh.lowest;
+    Real size = extent.x + extent.y + extent.z;
+    energyScale += (Real)vertexCount * mass * glm::length(scene.solver.gravity) * size;
+    cloths.push_back(cloth);
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::addParticle(Vec3 position, Vec3 velocity, Real mass, bool isPinned) {
+    positions.push_back(position);
+    velocities.push_back(velocity);
+    accelerations.push_back(Vec3(0.0f, 0.0f, 0.0f));
+    masses.push_back(mass);
+    inverseMasses.push_back(1 / mass);
+    pinned.push_back(isPinned ? 1 : 0);
+    pushed.push_back(0);
+    windForces.push_back(Vec3(0.0f, 0.0f, 0.0f));
+    // Once numbered, a new particle gets the next number
+    if (!particleNumbers.empty()) {
+        particleNumbers.push_back((GLuint)particleIndices.size());
+        particleIndices.push_back((GLuint)positions.size() - 1);
+    }
+    return (GLuint)positions.size() - 1;
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::step(bool push) {
+    scratch.reset();
+    iterations = 0;
+    // Tearing appends the particles it splits off, once they are a sixteenth of those that were
+    // in order the whole world is put in order again
+    if (!particleNumbers.empty() && positions.size() - orderedCount > orderedCount / 16)
+        reorder();
+    if (scene.solver.adaptive) {
+        adaptiveFrame(push);
+        return;
+    }
+    for (GLuint s = 0; s < scene.solver.substeps; s++)
+        substep(push);
+    PROFILE_COUNT(COUNTER_SUBSTEPS, scene.solver.substeps);
+    PROFILE_COUNT(COUNTER_ITERATIONS, iterations);
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::substep(bool push) {
+    computeWind();
+    if (scene.solver.method == SOLVER_PROJECTIVE) {
+        // Projects the springs instead of evaluating their forces
+        solveProjective(push);
+    } else if (scene.solver.method == SOLVER_IMPLICIT) {
+        computeForces(push);
+        solveImplicit();
+    } else {
+        computeForces(push);
+        integrate(scene.solver.h);
+        // The explicit integrator solves every substep in a single iteration
+        iterations++;
+    }
+    applyTethers();
+    collide();
+    tear();
+    time += scene.solver.h;
+}
+
+// Pages are at least this large, writing one byte every PAGE_SIZE bytes touches every page
+static const size_t PAGE_SIZE = 4096;
+
+// Moves array to fresh memory whose pages were first written by the workers that process them. The
+// new elements are left uninitialised and touched in the blocks of a loop over itemCount items that
+// does not steal, where item i owns the elements from firstElement(i) on, so every page lands on the
+// node of the partition its block belongs to, before the elements are copied in. Large arrays get
+// pages straight from the system, which have not been touched before. The old storage goes to
+// replaced, to be freed once every array has moved so it cannot be handed out again.
+template <typename T, typename FirstElement>
+static void placeArray(UninitialisedVector<T>& array, GLuint itemCount, FirstElement firstElement, ThreadPool& pool,
+                       std::vector<UninitialisedVector<T>>& replaced) {
+    if (array.empty())
+        return;
+
+    UninitialisedVector<T> placed;
+    placed.reserve(array.capacity());
+    placed.resize(array.size());
+    volatile char* bytes = reinterpret_cast<volatile char*>(placed.data());
+    auto touch = [bytes, firstElement](GLuint begin, GLuint end) {
+        uintptr_t first = (uintptr_t)(bytes + (size_t)firstElement(begin) * sizeof(T));
+        uintptr_t last = (uintptr_t)(bytes + (size_t)firstElement(end) * sizeof(T));
+        if (begin == 0)
+            bytes[0] = 0;
+        for (uintptr_t page = (first + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE; page < last; page += PAGE_SIZE)
+            *reinterpret_cast<volatile char*>(page) = 0;
+    };
+    pool.parallelFor(itemCount, World::BLOCK_SIZE, touch, false);
+    std::copy(array.begin(), array.end(), placed.begin());
+
+    replaced.emplace_back();
+    replaced.back().swap(array);
+    array.swap(placed);
+}
+
+// The same for an array processed element by element
+template <typename T>
+static void placeArray(UninitialisedVector<T>& array, ThreadPool& pool, std::vector<UninitialisedVector<T>>& replaced) {
+    placeArray(array, (GLuint)array.size(), [](GLuint element) { return element; }, pool, replaced);
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::setThreadPool(ThreadPool* thePool) {
+    pool = thePool;
+    multigrid.setThreadPool(pool);
+    if (pool && pool->getPartitionCount() > 1)
+        placeOnNodes();
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::placeOnNodes() {
+    std::vector<UninitialisedVector<Vec3>> vectors;
+    std::vector<UninitialisedVector<Real>> floats;
+    std::vector<UninitialisedVector<GLuint>> lists;
+    std::vector<UninitialisedVector<unsigned char>> flags;
+    std::vector<UninitialisedVector<Spring>> springLists;
+    std::vector<UninitialisedVector<GLfloat>> matrixValues;
+
+    placeArray(positions, *pool, vectors);
+    placeArray(velocities, *pool, vectors);
+    placeArray(accelerations, *pool, vectors);
+    placeArray(windForces, *pool, vectors);
+    placeArray(masses, *pool, floats);
+    placeArray(inverseMasses, *pool, floats);
+    placeArray(pinned, *pool, flags);
+    placeArray(pushed, *pool, flags);
+
+    placeArray(springs, *pool, springLists);
+    placeArray(restLengths, *pool, floats);
+    placeArray(springForces, *pool, vectors);
+    placeArray(dampForces, *pool, vectors);
+    placeArray(tornSprings, *pool, lists);
+
+    placeArray(tetherAnchors, *pool, lists);
+    placeArray(tetherLengths, *pool, floats);
+
+    placeArray(vertexSpringStart, *pool, lists);
+    placeArray(vertexSpringCount, *pool, lists);
+    placeArray(vertexSprings, *pool, lists);
+    placeArray(vertexTriangleStart, *pool, lists);
+    placeArray(vertexTriangleCount, *pool, lists);
+    placeArray(vertexTriangles, *pool, lists);
+
+    UninitialisedVector<Real>* triangleArrays[] = {&edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z,
+                                              &relativeX, &relativeY, &relativeZ, &aeroX, &aeroY, &aeroZ};
+    for (size_t i = 0; i < sizeof(triangleArrays) / sizeof(triangleArrays[0]); i++)
+        placeArray(*triangleArrays[i], *pool, floats);
+
+    UninitialisedVector<Real>* bendArrays[] = {&bendDamping, &bendInputX, &bendInputY, &bendInputZ,
+                                       &bendForceX,  &bendForceY, &bendForceZ};
+    for (size_t i = 0; i < sizeof(bendArrays) / sizeof(bendArrays[0]); i++)
+        placeArray(*bendArrays[i], *pool, floats);
+
+    // The entries of the bending matrix go with the rows, which are the particles, of their slice
+    const SlicedMatrix& matrix = bendingMatrix;
+    auto firstEntry = [&matrix](GLuint row) { return matrix.firstEntry(row); };
+    placeArray(bendingMatrix.columns, bendingMatrix.rowCount, firstEntry, *pool, lists);
+    placeArray(bendingMatrix.values, bendingMatrix.rowCount, firstEntry, *pool, matrixValues);
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::getClothCount() {
+    return (GLuint)cloths.size();
+}
+
+template <typename Real, typename Sum>
+const Cloth& BasicWorld<Real, Sum>::getCloth(GLuint cloth) {
+    return cloths[cloth];
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::getParticleCount() {
+    return (GLuint)positions.size();
+}
+
+template <typename Real, typename Sum>
+const std::vector<GLuint>& BasicWorld<Real, Sum>::getIndices() {
+    return particleNumbers.empty() ? indices : numberedIndices;
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::takeChangedTriangles(std::vector<GLuint>& triangles) {
+    std::sort(changedTriangles.begin(), changedTriangles.end());
+    for (GLuint t = 0; t < changedTriangles.size(); t++)
+        triangleChanged[changedTriangles[t]] = false;
+    triangles.assign(changedTriangles.begin(), changedTriangles.end());
+    changedTriangles.clear();
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::setPinned(GLuint number, bool isPinned) {
+    GLuint particle = particleIndex(number);
+    pinned[particle] = isPinned ? 1 : 0;
+    forcesValid = false;
+    if (isPinned)
+        velocities[particle] = Vec3(0.0f, 0.0f, 0.0f);
+    if (scene.solver.tethers)
+        findTethers();
+    if (scene.solver.method == SOLVER_IMPLICIT)
+        buildImplicit();
+    else if (scene.solver.method == SOLVER_PROJECTIVE)
+        buildProjective();
+}
+
+template <typename Real, typename Sum>
+bool BasicWorld<Real, Sum>::isPinned(GLuint number) {
+    return pinned[particleIndex(number)] != 0;
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::getSpringCount() {
+    return springCount;
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::getPositions(GLfloat* out) {
+    for (GLuint p = 0; p < positions.size(); p++) {
+        GLuint number = particleNumber(p);
+        out[3 * number] = positions[p].x;
+        out[3 * number + 1] = positions[p].y;
+        out[3 * number + 2] = positions[p].z;
+    }
+}
+
+template <typename Real, typename Sum>
+GLfloat BasicWorld<Real, Sum>::getEnergy() {
+    // Summed per block and then in block order, so the total does not depend on the threads
+    GLuint particleCount = (GLuint)positions.size();
+    GLuint particleBlocks = (particleCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    GLuint springBlocks = ((GLuint)springs.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    GLuint bendBlocks = bendDamping.empty() ? 0 : particleBlocks;
+    ArenaScope scope(scratch);
+    Sum* blockEnergy = scratch.allocate<Sum>(particleBlocks + springBlocks + bendBlocks);
+    SumVec3 gravity(scene.solver.gravity);
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        Sum energy = 0.0f;
+        for (GLuint index = begin; index < end; index++) {
+            Sum m = masses[index];
+            SumVec3 velocity(velocities[index]);
+            energy += Sum(0.5f) * m * glm::dot(velocity, velocity);
+            energy -= m * glm::dot(gravity, SumVec3(positions[index]));
+        }
+        blockEnergy[begin / BLOCK_SIZE] = energy;
+    });
+    forEachBlock((GLuint)springs.size(), [&](GLuint begin, GLuint end) {
+        Sum energy = 0.0f;
+        for (GLuint s = begin; s < end; s++) {
+            if (!springs[s].alive)
+                continue;
+            Sum stretch = glm::length(positions[springs[s].b] - positions[springs[s].a]) - restLength(s);
+            energy += Sum(0.5f) * materials[springs[s].material].k * stretch * stretch;
+        }
+        blockEnergy[particleBlocks + begin / BLOCK_SIZE] = energy;
+    });
+    // Half the quadratic form of the positions with the bending matrix, which takes the inputs
+    // of the product for the positions, they are formed again before the next product
+    if (!bendDamping.empty()) {
+        forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+            for (GLuint p = begin; p < end; p++) {
+                bendInputX[p] = positions[p].x;
+                bendInputY[p] = positions[p].y;
+                bendInputZ[p] = positions[p].z;
+            }
+        });
+        forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+            Sum form = bendingMatrix.quadraticForm<Real, Sum>(bendInputX.data(), bendInputY.data(), bendInputZ.data(),
+                                                              begin, end);
+            blockEnergy[particleBlocks + springBlocks + begin / BLOCK_SIZE] = Sum(0.5f) * form;
+        });
+    }
+
+    Sum energy = 0.0f;
+    for (GLuint b = 0; b < particleBlocks + springBlocks + bendBlocks; b++)
+        energy += blockEnergy[b];
+    return energy;
+}
+
+template <typename Real, typename Sum>
+GLfloat BasicWorld<Real, Sum>::getEnergyScale() {
+    return energyScale;
+}
+
+template <typename Real, typename Sum>
+GLfloat BasicWorld<Real, Sum>::getMaxStrain() {
+    Real strain = 0.0f;
+    for (GLuint s = 0; s < springs.size(); s++) {
+        const Spring& spring = springs[s];
+        if (spring.alive && spring.type == SPRING_STRUCTURAL) {
+            Real length = glm::length(positions[spring.b] - positions[spring.a]);
+            strain = std::max(strain, std::fabs(length - restLength(s)) / restLength(s));
+        }
+    }
+    return strain;
+}
+
+template <typename Real, typename Sum>
+GLfloat BasicWorld<Real, Sum>::getFrameTime() {
+    return scene.solver.h * scene.solver.substeps;
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::getIterations() {
+    return iterations;
+}
+
+uint64_t World::getStateHash() {
+    uint64_t hash = FNV_OFFSET;
+    for (GLuint p = 0; p < getParticleCount(); p++) {
+        GLfloat state[6];
+        getStates(p, 1, state);
+        hash = hashStates(state, 1, hash);
+    }
+    return hash;
+}
+
+uint64_t World::hashStates(const GLfloat* states, GLuint count, uint64_t hash) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(states);
+    for (size_t b = 0; b < (size_t)count * 6 * sizeof(GLfloat); b++) {
+        hash ^= bytes[b];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::getStates(GLuint first, GLuint count, GLfloat* states) {
+    for (GLuint number = first; number < first + count; number++, states += 6) {
+        GLuint p = particleIndex(number);
+        states[0] = positions[p].x;
+        states[1] = positions[p].y;
+        states[2] = positions[p].z;
+        states[3] = velocities[p].x;
+        states[4] = velocities[p].y;
+        states[5] = velocities[p].z;
+    }
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::setStates(GLuint first, GLuint count, const GLfloat* states) {
+    forcesValid = false;
+    for (GLuint number = first; number < first + count; number++, states += 6) {
+        GLuint p = particleIndex(number);
+        positions[p] = Vec3(states[0], states[1], states[2]);
+        velocities[p] = Vec3(states[3], states[4], states[5]);
+    }
+}
+
+template <typename Real, typename Sum>
+GLfloat BasicWorld<Real, Sum>::getRestLengthError() {
+    return restLengthError;
+}
+
+template <typename Real, typename Sum>
+size_t BasicWorld<Real, Sum>::getSpringBytes() {
+    return springs.size() * sizeof(Spring) + restLengths.size() * sizeof(Real);
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::forEachBlock(GLuint count, BlockFunction work) {
+    if (pool) {
+        pool->parallelFor(count, BLOCK_SIZE, work);
+        return;
+    }
+    for (GLuint begin = 0; begin < count; begin += BLOCK_SIZE)
+        work(begin, std::min(begin + BLOCK_SIZE, count));
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::addSpring(GLuint a, GLuint b, Real restLength, SpringType type, GLuint material) {
+    Spring spring;
+    spring.a = a;
+    spring.b = b;
+    spring.quantisedLength = 0;
+    spring.material = material;
+    spring.type = type;
+    spring.alive = 1;
+    if (lengthQuantum > 0.0f) {
+        Real quantised = std::min(std::round(restLength / lengthQuantum), Real(UINT16_MAX));
+        spring.quantisedLength = (GLushort)quantised;
+        restLengthError = std::max(restLengthError, std::fabs(quantised * lengthQuantum - restLength) / restLength);
+    } else {
+        restLengths.push_back(restLength);
+    }
+    springs.push_back(spring);
+    springCount++;
+}
+
+template <typename Real, typename Sum>
+Real BasicWorld<Real, Sum>::restLength(GLuint spring) {
+    if (lengthQuantum > 0.0f)
+        return lengthQuantum * springs[spring].quantisedLength;
+    return restLengths[spring];
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::particleNumber(GLuint particle) {
+    return particleNumbers.empty() ? particle : particleNumbers[particle];
+}
+
+template <typename Real, typename Sum>
+GLuint BasicWorld<Real, Sum>::particleIndex(GLuint number) {
+    return particleIndices.empty() ? number : particleIndices[number];
+}
+
+// Spreads value, at most 21 bits, to every third bit
+static uint64_t spreadBits(uint64_t value) {
+    value = std::min(value, (uint64_t)0x1fffff);
+    value = (value | value << 32) & 0x1f00000000ffffULL;
+    value = (value | value << 16) & 0x1f0000ff0000ffULL;
+    value = (value | value << 8) & 0x100f00f00f00f00fULL;
+    value = (value | value << 4) & 0x10c30c30c30c30c3ULL;
+    value = (value | value << 2) & 0x1249249249249249ULL;
+    return value;
+}
+
+// Moves element i of array to moves[i], through buffer
+template <typename T>
+static void permute(UninitialisedVector<T>& array, const GLuint* moves, void* buffer) {
+    T* moved = static_cast<T*>(buffer);
+    for (size_t i = 0; i < array.size(); i++)
+        moved[moves[i]] = array[i];
+    std::copy(moved, moved + array.size(), array.begin());
+}
+
+// Puts the particles in the order of a Morton curve through their positions, which visits the
+// cells of an octree around them one after the other, so particles near each other in space are
+// mostly near each other in the arrays and the gathers of the forces and the collisions stay in
+// the caches. The springs of every cloth are sorted by their new particles and the segments of
+// the particles rebuilt in the new order. Every particle keeps its number, its springs and
+// triangles keep their order in its segments, and the splits of a tear and the tether searches go
+// by the numbers, so the states come out bitwise the same as in grid order. Only the energy sums
+// and the numbering of the Cholesky factor differ.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::reorder() {
+    GLuint particleCount = (GLuint)positions.size();
+    GLuint springTotal = (GLuint)springs.size();
+    ArenaScope scope(scratch);
+
+    // 21 bits per coordinate over a cube around the particles, equal codes in number order
+    Vec3 lowest = positions[0], highest = positions[0];
+    for (GLuint p = 1; p < particleCount; p++) {
+        lowest = glm::min(lowest, positions[p]);
+        highest = glm::max(highest, positions[p]);
+    }
+    Vec3 extent = highest - lowest;
+    Real size = std::max(extent.x, std::max(extent.y, extent.z));
+    Real scale = size > 0.0f ? Real((1u << 21) - 1) / size : Real(0);
+    OrderKey* keys = scratch.allocate<OrderKey>(particleCount);
+    for (GLuint p = 0; p < particleCount; p++) {
+        Vec3 cell = (positions[p] - lowest) * scale;
+        keys[p].code = spreadBits((uint64_t)cell.x) | spreadBits((uint64_t)cell.y) << 1 | spreadBits((uint64_t)cell.z) << 2;
+        keys[p].item = particleNumbers[p];
+    }
+    std::sort(keys, keys + particleCount);
+
+    GLuint* moves = scratch.allocate<GLuint>(particleCount);
+    for (GLuint i = 0; i < particleCount; i++) {
+        GLuint number = keys[i].item;
+        moves[particleIndices[number]] = i;
+        particleNumbers[i] = number;
+        particleIndices[number] = i;
+    }
+
+    // The springs stay in the range of their cloth, sorted by their lower and then higher particle
+    OrderKey* springKeys = scratch.allocate<OrderKey>(springTotal);
+    GLuint* springMoves = scratch.allocate<GLuint>(springTotal);
+    for (GLuint s = 0; s < springTotal; s++) {
+        GLuint a = moves[springs[s].a], b = moves[springs[s].b];
+        springKeys[s].code = (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+        springKeys[s].item = s;
+    }
+    for (GLuint c = 0; c < cloths.size(); c++)
+        std::sort(springKeys + cloths[c].firstSpring, springKeys + cloths[c].firstSpring + cloths[c].springCount);
+    for (GLuint s = 0; s < springTotal; s++)
+        springMoves[springKeys[s].item] = s;
+
+    size_t bufferBytes = std::max(std::max(particleCount * sizeof(Vec3), springTotal * sizeof(Spring)),
+                                  std::max(vertexSprings.size(), vertexTriangles.size()) * sizeof(GLuint));
+    void* buffer = scratch.allocate(bufferBytes, alignof(Vec3));
+
+    permute(positions, moves, buffer);
+    permute(velocities, moves, buffer);
+    permute(accelerations, moves, buffer);
+    permute(windForces, moves, buffer);
+    permute(masses, moves, buffer);
+    permute(inverseMasses, moves, buffer);
+    permute(pinned, moves, buffer);
+    permute(pushed, moves, buffer);
+    permute(tetherLengths, moves, buffer);
+    permute(tetherAnchors, moves, buffer);
+    for (GLuint p = 0; p < tetherAnchors.size(); p++) {
+        if (tetherAnchors[p] != UINT32_MAX)
+            tetherAnchors[p] = moves[tetherAnchors[p]];
+    }
+
+    // The forces of the springs are computed again before they are read
+    permute(springs, springMoves, buffer);
+    permute(restLengths, springMoves, buffer);
+    for (GLuint s = 0; s < springTotal; s++) {
+        springs[s].a = moves[springs[s].a];
+        springs[s].b = moves[springs[s].b];
+    }
+    for (GLuint v = 0; v < indices.size(); v++)
+        indices[v] = moves[indices[v]];
+
+    // The segments are laid out again in the new order, which also closes the gaps torn springs left
+    permute(vertexSpringStart, moves, buffer);
+    permute(vertexSpringCount, moves, buffer);
+    GLuint* list = static_cast<GLuint*>(buffer);
+    GLuint listSize = 0;
+    for (GLuint p = 0; p < particleCount; p++) {
+        for (GLuint n = 0; n < vertexSpringCount[p]; n++)
+            list[listSize + n] = springMoves[vertexSprings[vertexSpringStart[p] + n]];
+        vertexSpringStart[p] = listSize;
+        listSize += vertexSpringCount[p];
+    }
+    std::copy(list, list + listSize, vertexSprings.begin());
+
+    permute(vertexTriangleStart, moves, buffer);
+    permute(vertexTriangleCount, moves, buffer);
+    listSize = 0;
+    for (GLuint p = 0; p < particleCount; p++) {
+        std::copy(vertexTriangles.begin() + vertexTriangleStart[p],
+                  vertexTriangles.begin() + vertexTriangleStart[p] + vertexTriangleCount[p], list + listSize);
+        vertexTriangleStart[p] = listSize;
+        listSize += vertexTriangleCount[p];
+    }
+    std::copy(list, list + listSize, vertexTriangles.begin());
+
+    orderedCount = particleCount;
+}
+
+// Cotangent of the angle between u and v
+static double cotangent(glm::dvec3 u, glm::dvec3 v) {
+    return glm::dot(u, v) / glm::length(glm::cross(u, v));
+}
+
+// Assembles the matrix of quadratic bending (Bergou et al., A Quadratic Bending Model for
+// Inextensible Surfaces) from the particles as they are, which is the rest shape. An edge x0 x1
+// shared by the triangles x0 x1 x2 and x0 x1 x3 gets the weights
+//
+//   K = (c03 + c04, c01 + c02, -c01 - c03, -c02 - c04) * sqrt(3 * bendStiffness / (A0 + A1))
+//
+// with cij the cotangent of the angle of the triangles between e0 = x1 - x0 and e1 = x2 - x0 or
+// e2 = x3 - x0 at x0, and between -e0 and e3 = x2 - x1 or e4 = x3 - x1 at x1. K x is zero for a
+// flat pair of triangles, so the energy |K x|^2 / 2 grows with the square of the angle they fold
+// by. It keeps its value when the cloth only bends without stretching, which cloth barely does,
+// and then the energy of all edges is quadratic in the positions, with the sum of the outer
+// products K K^T over the edges as its Hessian. That holds for cloths that are flat at rest, a
+// curved mesh is pulled towards flat.
+//
+// The diagonal follows from the rest of its row, which sums to zero, and is not assembled. The
+// entries are summed and ordered by the numbers of the particles, so every row of the matrix is
+// summed in the same order whatever order the particles are kept in.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::buildBending() {
+    GLuint particleCount = (GLuint)positions.size();
+    std::vector<MatrixEntry> entries;
+    bendDamping.assign(particleCount, Real(0));
+    for (GLuint c = 0; c < cloths.size(); c++) {
+        const Cloth& cloth = cloths[c];
+        const Material& material = materials[cloth.material];
+        double stiffness = material.bendStiffness;
+        if (stiffness <= 0.0)
+            continue;
+        Real damping = material.k > 0.0f ? Real(material.b / material.k) : Real(0);
+        for (GLuint p = cloth.firstParticle; p < cloth.firstParticle + cloth.width * cloth.height; p++)
+            bendDamping[particleIndex(p)] = damping;
+
+        for (GLuint t = cloth.firstTriangle; t < cloth.firstTriangle + cloth.triangleCount; t++) {
+            for (GLuint corner = 0; corner < 3; corner++) {
+                GLuint a = indices[3 * t + corner], b = indices[3 * t + (corner + 1) % 3];
+                GLuint across = indices[3 * t + (corner + 2) % 3];
+
+                // The edge bends if exactly one other triangle has it, the later of the two sets it up
+                GLuint other = UINT32_MAX, sharing = 0;
+                GLuint first = vertexTriangleStart[a];
+                for (GLuint n = first; n < first + vertexTriangleCount[a]; n++) {
+                    GLuint u = vertexTriangles[n];
+                    if (u != t && (indices[3 * u] == b || indices[3 * u + 1] == b || indices[3 * u + 2] == b)) {
+                        other = u;
+                        sharing++;
+                    }
+                }
+                if (sharing != 1 || other > t)
+                    continue;
+                GLuint opposite = indices[3 * other];
+                for (GLuint v = 1; v < 3 && (opposite == a || opposite == b); v++)
+                    opposite = indices[3 * other + v];
+                if (opposite == across)
+                    continue;
+
+                glm::dvec3 x0(positions[a]), x1(positions[b]), x2(positions[across]), x3(positions[opposite]);
+                glm::dvec3 e0 = x1 - x0, e1 = x2 - x0, e2 = x3 - x0, e3 = x2 - x1, e4 = x3 - x1;
+                double area0 = 0.5 * glm::length(glm::cross(e0, e1)), area1 = 0.5 * glm::length(glm::cross(e0, e2));
+                if (area0 <= 0.0 || area1 <= 0.0)
+                    continue;
+                double c01 = cotangent(e0, e1), c02 = cotangent(e0, e2);
+                double c03 = cotangent(-e0, e3), c04 = cotangent(-e0, e4);
+                double scale = 3.0 * stiffness / (area0 + area1);
+
+                GLuint numbers[4] = {particleNumber(a), particleNumber(b), particleNumber(across), particleNumber(opposite)};
+                double weights[4] = {c03 + c04, c01 + c02, -c01 - c03, -c02 - c04};
+                for (GLuint i = 0; i < 4; i++) {
+                    for (GLuint j = 0; j < 4; j++) {
+                        MatrixEntry entry = {numbers[i], numbers[j], GLfloat(scale * weights[i] * weights[j])};
+                        if (i != j)
+                            entries.push_back(entry);
+                    }
+                }
+            }
+        }
+    }
+
+    // The entries of an element are summed in the order of the edges, which a band of a cloth
+    // split over processes has the same for its rows
+    SparseMatrix hessian = SparseMatrix::fromOrderedEntries(particleCount, particleCount, entries);
+    bendingMatrix = SlicedMatrix(hessian, particleIndices);
+
+    bendInputX.resize(particleCount); bendInputY.resize(particleCount); bendInputZ.resize(particleCount);
+    bendForceX.resize(particleCount); bendForceY.resize(particleCount); bendForceZ.resize(particleCount);
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::computeForces(bool push) {
+    PROFILE_SCOPE(PHASE_FORCES);
+    PROFILE_COUNT(COUNTER_SPRINGS, springCount);
+
+    // Every spring is evaluated once, springs stretched past the tear strain are noted for tear()
+    forEachBlock((GLuint)springs.size(), [&](GLuint begin, GLuint end) {
+        GLuint block = begin / BLOCK_SIZE;
+        for (GLuint s = begin; s < end; s++) {
+            const Spring& spring = springs[s];
+            if (!spring.alive)
+                continue;
+            const Material& material = materials[spring.material];
+            springForces[s] = theSpringForce(positions[spring.a], positions[spring.b], restLength(s), Real(material.k));
+            dampForces[s] = theDampForce(velocities[spring.a], velocities[spring.b], Real(material.b));
+
+            if (material.tearStrain > 0.0f) {
+                Real length = glm::length(positions[spring.b] - positions[spring.a]);
+                if (length > (1.0f + material.tearStrain) * restLength(s))
+                    tornSprings[block * BLOCK_SIZE + tornCounts[block]++] = s;
+            }
+        }
+    });
+
+    // Bending, the product of the bending matrix with the positions and damped velocities
+    if (!bendDamping.empty()) {
+        forEachBlock((GLuint)positions.size(), [&](GLuint begin, GLuint end) {
+            for (GLuint p = begin; p < end; p++) {
+                Vec3 input = positions[p] + bendDamping[p] * velocities[p];
+                bendInputX[p] = input.x;
+                bendInputY[p] = input.y;
+                bendInputZ[p] = input.z;
+            }
+        });
+        forEachBlock((GLuint)positions.size(), [&](GLuint begin, GLuint end) {
+            bendingMatrix.multiply<Real, Sum>(bendInputX.data(), bendInputY.data(), bendInputZ.data(), bendForceX.data(),
+                                              bendForceY.data(), bendForceZ.data(), begin, end);
+        });
+    }
+
+    // Calculate the forces acting on the particles, every particle only writes its own acceleration
+    forEachBlock((GLuint)positions.size(), [&](GLuint begin, GLuint end) {
+        for (GLuint index = begin; index < end; index++) {
+            // Set the current acceleration of the particle
+            accelerations[index] = Vec3(Sum(inverseMasses[index]) * particleForce(index, push));
+        }
+    });
+}
+
+// Sums the spring, damping and external forces acting on a particle
+template <typename Real, typename Sum>
+typename BasicWorld<Real, Sum>::SumVec3 BasicWorld<Real, Sum>::particleForce(GLuint index, bool push) {
+    SumVec3 theForce = SumVec3(0.0f, 0.0f, 0.0f);
+
+    // Springs and dampers, the forces were computed for particle a of every spring
+    GLuint first = vertexSpringStart[index];
+    for (GLuint n = first; n < first + vertexSpringCount[index]; n++) {
+        GLuint s = vertexSprings[n];
+        if (springs[s].a == index) {
+            theForce += springForces[s];
+            theForce -= dampForces[s];
+        } else {
+            theForce -= springForces[s];
+            theForce += dampForces[s];
+        }
+    }
+
+    // Bending pulls against the product
+    if (!bendDamping.empty())
+        theForce -= SumVec3(bendForceX[index], bendForceY[index], bendForceZ[index]);
+
+    if (push && pushed[index]) {
+        theForce += scene.push;
+    }
+
+    // Add gravity and wind
+    theForce += scene.solver.gravity;
+    theForce += windForces[index];
+
+    return theForce;
+}
+
+// The push, gravity and wind acting on a particle
+template <typename Real, typename Sum>
+typename BasicWorld<Real, Sum>::SumVec3 BasicWorld<Real, Sum>::outerForce(GLuint index, bool push) {
+    SumVec3 theForce = SumVec3(0.0f, 0.0f, 0.0f);
+    if (push && pushed[index])
+        theForce += scene.push;
+    theForce += scene.solver.gravity;
+    theForce += windForces[index];
+    return theForce;
+}
+
+// Removes the springs stretched past the tear strain during this substep and splits the
+// particles they belonged to where the cloth came apart. Only the torn springs and the
+// particles at their ends are visited.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::tear() {
+    GLuint tornTotal = 0;
+    for (GLuint block = 0; block < tornCounts.size(); block++)
+        tornTotal += tornCounts[block];
+    if (tornTotal == 0)
+        return;
+
+    GLuint* affected = scratch.allocate<GLuint>(2 * tornTotal);
+    GLuint affectedCount = 0;
+    for (GLuint block = 0; block < tornCounts.size(); block++) {
+        for (GLuint n = 0; n < tornCounts[block]; n++) {
+            GLuint s = tornSprings[block * BLOCK_SIZE + n];
+            Spring& spring = springs[s];
+            if (!spring.alive)
+                continue;
+            spring.alive = 0;
+            springCount--;
+
+            GLuint ends[2] = {spring.a, spring.b};
+            for (GLuint e = 0; e < 2; e++) {
+                GLuint* list = &vertexSprings[vertexSpringStart[ends[e]]];
+                GLuint* last = std::remove(list, list + vertexSpringCount[ends[e]], s);
+                vertexSpringCount[ends[e]] = (GLuint)(last - list);
+                affected[affectedCount++] = ends[e];
+            }
+        }
+        tornCounts[block] = 0;
+    }
+
+    // In the order of their numbers, the particles split off are numbered in the order they are made
+    std::sort(affected, affected + affectedCount, [this](GLuint x, GLuint y) {
+        return particleNumber(x) < particleNumber(y);
+    });
+    affectedCount = (GLuint)(std::unique(affected, affected + affectedCount) - affected);
+    for (GLuint a = 0; a < affectedCount; a++)
+        splitParticle(affected[a]);
+
+    // The paths to the pins only get longer, the old tethers would hold pieces torn off
+    if (scene.solver.tethers)
+        findTethers();
+}
+
+template <typename Real, typename Sum>
+bool BasicWorld<Real, Sum>::hasSpring(GLuint particle, GLuint other) {
+    GLuint first = vertexSpringStart[particle];
+    for (GLuint n = first; n < first + vertexSpringCount[particle]; n++) {
+        const Spring& spring = springs[vertexSprings[n]];
+        if (spring.a == other || spring.b == other)
+            return true;
+    }
+    return false;
+}
+
+// Groups the triangles of a particle into sets that still hang together, two triangles hang
+// together when they share an edge whose spring is not torn. Every set but the first gets a
+// copy of the particle, with the springs leading into that set.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::splitParticle(GLuint particle) {
+    GLuint first = vertexTriangleStart[particle];
+    GLuint count = vertexTriangleCount[particle];
+    if (count < 2)
+        return;
+    ArenaScope scope(scratch);
+
+    // Connected sets of triangles, labelled by their first triangle
+    GLuint* label = scratch.allocate<GLuint>(count);
+    for (GLuint x = 0; x < count; x++)
+        label[x] = x;
+    for (GLuint x = 0; x < count; x++) {
+        const GLuint* cornersX = &indices[3 * vertexTriangles[first + x]];
+        for (GLuint y = x + 1; y < count; y++) {
+            const GLuint* cornersY = &indices[3 * vertexTriangles[first + y]];
+            bool joined = false;
+            for (GLuint c = 0; c < 3 && !joined; c++) {
+                GLuint other = cornersX[c];
+                if (other != particle && (cornersY[0] == other || cornersY[1] == other || cornersY[2] == other))
+                    joined = hasSpring(particle, other);
+            }
+            if (joined && label[x] != label[y]) {
+                GLuint from = std::max(label[x], label[y]), to = std::min(label[x], label[y]);
+                for (GLuint z = 0; z < count; z++) {
+                    if (label[z] == from)
+                        label[z] = to;
+                }
+            }
+        }
+    }
+    if (std::count(label, label + count, label[0]) == (long)count)
+        return;
+
+    // Every spring follows the set that holds its other particle, or the nearest set when no
+    // triangle of the particle reaches it (bend and long shear springs)
+    GLuint springFirst = vertexSpringStart[particle];
+    GLuint springTotal = vertexSpringCount[particle];
+    GLuint* springLabel = scratch.allocate<GLuint>(springTotal);
+    for (GLuint n = 0; n < springTotal; n++) {
+        const Spring& spring = springs[vertexSprings[springFirst + n]];
+        GLuint other = spring.a == particle ? spring.b : spring.a;
+        Vec3 otherPosition = positions[other];
+
+        springLabel[n] = 0;
+        Real nearest = FLT_MAX;
+        for (GLuint x = 0; x < count; x++) {
+            const GLuint* corners = &indices[3 * vertexTriangles[first + x]];
+            if (corners[0] == other || corners[1] == other || corners[2] == other) {
+                springLabel[n] = label[x];
+                break;
+            }
+            Vec3 center = (positions[corners[0]] + positions[corners[1]] + positions[corners[2]]) / Real(3);
+            Real distance = glm::length(center - otherPosition);
+            if (distance < nearest) {
+                nearest = distance;
+                springLabel[n] = label[x];
+            }
+        }
+    }
+
+    // The sets divide the particle's segments between them in the order of their first triangle,
+    // each keeping the order its triangles and springs had. The particle keeps the first set.
+    GLuint* ownTriangles = scratch.allocate<GLuint>(count);
+    GLuint* ownSprings = scratch.allocate<GLuint>(springTotal);
+    std::copy(vertexTriangles.begin() + first, vertexTriangles.begin() + first + count, ownTriangles);
+    std::copy(vertexSprings.begin() + springFirst, vertexSprings.begin() + springFirst + springTotal, ownSprings);
+
+    GLuint triangleEnd = first, springEnd = springFirst;
+    for (GLuint x = 0; x < count; x++) {
+        if (label[x] != x)
+            continue;
+
+        // A new particle for every set but the first
+        GLuint owner = particle;
+        if (x > 0)
+            owner = addParticle(positions[particle], velocities[particle], masses[particle], pinned[particle] != 0);
+
+        GLuint triangleStart = triangleEnd;
+        for (GLuint y = x; y < count; y++) {
+            if (label[y] != x)
+                continue;
+            GLuint t = ownTriangles[y];
+            if (owner != particle) {
+                for (GLuint c = 0; c < 3; c++) {
+                    if (indices[3 * t + c] == particle) {
+                        indices[3 * t + c] = owner;
+                        if (!numberedIndices.empty())
+                            numberedIndices[3 * t + c] = particleNumber(owner);
+                    }
+                }
+                if (!triangleChanged[t]) {
+                    triangleChanged[t] = true;
+                    changedTriangles.push_back(t);
+                }
+            }
+            vertexTriangles[triangleEnd++] = t;
+        }
+
+        GLuint springStart = springEnd;
+        for (GLuint n = 0; n < springTotal; n++) {
+            if (springLabel[n] != x)
+                continue;
+            if (owner != particle) {
+                Spring& spring = springs[ownSprings[n]];
+                if (spring.a == particle)
+                    spring.a = owner;
+                else
+                    spring.b = owner;
+            }
+            vertexSprings[springEnd++] = ownSprings[n];
+        }
+
+        if (owner == particle) {
+            vertexTriangleCount[particle] = triangleEnd - triangleStart;
+            vertexSpringCount[particle] = springEnd - springStart;
+        } else {
+            vertexTriangleStart.push_back(triangleStart);
+            vertexTriangleCount.push_back(triangleEnd - triangleStart);
+            vertexSpringStart.push_back(springStart);
+            vertexSpringCount.push_back(springEnd - springStart);
+        }
+    }
+}
+
+// The wind velocity at a position at the current time
+template <typename Real, typename Sum>
+typename BasicWorld<Real, Sum>::Vec3 BasicWorld<Real, Sum>::windAt(Vec3 position) {
+    const Wind& wind = scene.wind;
+    if (wind.type == WIND_TURBULENT) {
+        // Three decorrelated noise fields, one per coordinate, drifting with time. The noise is
+        // evaluated in float whatever the precision, it only shapes the wind.
+        glm::vec3 p = glm::vec3(Real(wind.turbulenceScale) * position);
+        GLfloat t = (GLfloat)(wind.turbulenceFrequency * time);
+        return Vec3(wind.velocity + wind.turbulence * glm::vec3(glm::simplex(glm::vec4(p, t)),
+                                                                glm::simplex(glm::vec4(p + glm::vec3(31.4f, 0.0f, 0.0f), t)),
+                                                                glm::simplex(glm::vec4(p + glm::vec3(0.0f, 27.1f, 0.0f), t))));
+    }
+    if (wind.type == WIND_GUSTS) {
+        // Short swells: the fourth power keeps the wind close to its base speed most of the period
+        Real phase = Real(0.5f) - Real(0.5f) * std::cos(Real(2) * glm::pi<Real>() * time / wind.gustPeriod);
+        return (Real(1) + wind.gustStrength * phase * phase * phase * phase) * Vec3(wind.velocity);
+    }
+    return Vec3(wind.velocity);
+}
+
+// Computes the drag and lift of every triangle and hands a third of it to each of its vertices
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::computeWind() {
+    if (scene.wind.type == WIND_NONE)
+        return;
+    PROFILE_SCOPE(PHASE_WIND);
+
+    GLuint particleCount = (GLuint)positions.size();
+    GLuint triangleCount = (GLuint)indices.size() / 3;
+
+    // F = 1/2 density |v|^2 area (drag |cos| v/|v| + lift cos (n - cos v/|v|)), shared by three vertices
+    Real dragFactor = scene.wind.density * scene.wind.drag / 12.0f;
+    Real liftFactor = scene.wind.density * scene.wind.lift / 12.0f;
+    bool uniform = scene.wind.type == WIND_UNIFORM;
+
+    forEachBlock(triangleCount, [&](GLuint begin, GLuint end) {
+        for (GLuint t = begin; t < end; t++) {
+            GLuint a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+
+            Vec3 edge1 = positions[b] - positions[a];
+            Vec3 edge2 = positions[c] - positions[a];
+            Vec3 wind = uniform ? Vec3(scene.wind.velocity) : windAt((positions[a] + positions[b] + positions[c]) / Real(3));
+            Vec3 relative = wind - (velocities[a] + velocities[b] + velocities[c]) / Real(3);
+
+            edge1X[t] = edge1.x;
+            edge1Y[t] = edge1.y;
+            edge1Z[t] = edge1.z;
+            edge2X[t] = edge2.x;
+            edge2Y[t] = edge2.y;
+            edge2Z[t] = edge2.z;
+            relativeX[t] = relative.x;
+            relativeY[t] = relative.y;
+            relativeZ[t] = relative.z;
+        }
+        aerodynamicForces(begin, end, edge1X.data(), edge1Y.data(), edge1Z.data(),
+                          edge2X.data(), edge2Y.data(), edge2Z.data(),
+                          relativeX.data(), relativeY.data(), relativeZ.data(), dragFactor, liftFactor,
+                          aeroX.data(), aeroY.data(), aeroZ.data());
+    });
+
+    // Every vertex sums its triangles in the same order, whatever the threads
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            SumVec3 force(0.0f, 0.0f, 0.0f);
+            for (GLuint n = vertexTriangleStart[p]; n < vertexTriangleStart[p] + vertexTriangleCount[p]; n++) {
+                GLuint t = vertexTriangles[n];
+                force += Vec3(aeroX[t], aeroY[t], aeroZ[t]);
+            }
+            windForces[p] = Vec3(force);
+        }
+    });
+}
+
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::integrate(Real h) {
+    PROFILE_SCOPE(PHASE_INTEGRATE);
+
+    forEachBlock((GLuint)positions.size(), [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            if (!pinned[p]) {
+                // Set the new positions and velocities of the particles
+                positions[p] = RungeKuttaForPosDiff(velocities[p], h) + positions[p];
+                velocities[p] = RungeKuttaForVel(velocities[p], accelerations[p], h);
+            }
+        }
+    });
+}
+
+// Finds the nearest pin of every particle along the springs that have not torn, with a search
+// from all pins at once over the rest lengths. Equally near pins go to the one with the lower
+// number and the queue holds numbers as well, so the tethers do not depend on anything but the
+// springs and pins, not even on the order of the particles.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::findTethers() {
+    GLuint particleCount = (GLuint)positions.size();
+    tetherAnchors.assign(particleCount, UINT32_MAX);
+    tetherLengths.assign(particleCount, FLT_MAX);
+    tetherQueue.clear();
+
+    // The queue is a heap of (length, particle) with the shortest on top, particles are queued
+    // again when a shorter path turns up and the longer entries skipped when they come out
+    std::greater<std::pair<Real, GLuint>> later;
+    for (GLuint p = 0; p < particleCount; p++) {
+        if (pinned[p]) {
+            tetherAnchors[p] = p;
+            tetherLengths[p] = 0.0f;
+            tetherQueue.push_back(std::make_pair(Real(0), particleNumber(p)));
+        }
+    }
+    std::make_heap(tetherQueue.begin(), tetherQueue.end(), later);
+
+    while (!tetherQueue.empty()) {
+        std::pop_heap(tetherQueue.begin(), tetherQueue.end(), later);
+        Real length = tetherQueue.back().first;
+        GLuint p = particleIndex(tetherQueue.back().second);
+        tetherQueue.pop_back();
+        if (length > tetherLengths[p])
+            continue;
+
+        GLuint first = vertexSpringStart[p];
+        for (GLuint n = first; n < first + vertexSpringCount[p]; n++) {
+            const Spring& spring = springs[vertexSprings[n]];
+            GLuint other = spring.a == p ? spring.b : spring.a;
+            Real otherLength = length + restLength(vertexSprings[n]);
+            if (otherLength < tetherLengths[other]
+                || (otherLength == tetherLengths[other]
+                    && particleNumber(tetherAnchors[p]) < particleNumber(tetherAnchors[other]))) {
+                bool queued = otherLength == tetherLengths[other];
+                tetherLengths[other] = otherLength;
+                tetherAnchors[other] = tetherAnchors[p];
+                if (!queued) {
+                    tetherQueue.push_back(std::make_pair(otherLength, particleNumber(other)));
+                    std::push_heap(tetherQueue.begin(), tetherQueue.end(), later);
+                }
+            }
+        }
+    }
+}
+
+// Moves the particles further from their pin than their tether allows back to that distance,
+// and removes the part of their velocity leading away from the pin
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::applyTethers() {
+    if (!scene.solver.tethers)
+        return;
+    PROFILE_SCOPE(PHASE_INTEGRATE);
+    Real stretch = 1.0f + scene.solver.tetherSlack;
+
+    // The pins do not move, so every particle only reads positions no other particle writes
+    forEachBlock((GLuint)positions.size(), [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            GLuint anchor = tetherAnchors[p];
+            if (pinned[p] || anchor == UINT32_MAX)
+                continue;
+
+            Vec3 fromAnchor = positions[p] - positions[anchor];
+            Real distance = glm::length(fromAnchor);
+            Real allowed = stretch * tetherLengths[p];
+            if (distance <= allowed)
+                continue;
+
+            Vec3 direction = fromAnchor / distance;
+            positions[p] = positions[anchor] + allowed * direction;
+            Real outwards = glm::dot(velocities[p], direction);
+            if (outwards > 0.0f)
+                velocities[p] -= outwards * direction;
+        }
+    });
+}
+
+// Advances one frame in explicit steps of varying size. The integrator is Euler's method, whose
+// velocities differ from those of Heun's method by h/2 |a1 - a0|, a1 the accelerations at the end
+// of the step, so after the step the positions would be h^2/2 |a1 - a0| apart. That is the error
+// estimate of a step, found with the forces the next step needs anyway. A step estimated to be
+// off by more than errorTolerance times the shortest rest length is taken back and tried again
+// shorter. The next step is sized from the error of the last one, and kept short enough that no
+// particle moves further than cfl times the shortest rest length. Every force evaluation counts
+// as an iteration.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::adaptiveFrame(bool push) {
+    const SolverSettings& solver = scene.solver;
+    Real frameTime = getFrameTime();
+    Real maxSize = solver.maxH > 0.0f ? std::min(Real(solver.maxH), frameTime) : frameTime;
+    Real tolerance = solver.errorTolerance * shortestRestLength;
+    Real minH = solver.minH;
+    GLuint particleCount = (GLuint)positions.size();
+
+    Real elapsed = 0.0f, savedElapsed = 0.0f, savedTime = 0.0f, lastSize = 0.0f;
+    bool pending = false, lastStep = false, cut = false;
+    GLuint steps = 0;
+    while (true) {
+        if (!forcesValid || forcesPush != push) {
+            computeWind();
+            computeForces(push);
+            iterations++;
+            forcesValid = true;
+            forcesPush = push;
+        }
+
+        if (pending) {
+            pending = false;
+            Real error = 0.5f * lastSize * lastSize * largestDifference(accelerations.data(), savedAccelerations.data());
+            Real scale = error > 0.0f ? Real(0.9f) * std::sqrt(tolerance / error) : Real(2);
+            scale = std::min(std::max(scale, Real(0.2f)), Real(2));
+
+            if (error > tolerance && lastSize > minH) {
+                // Back to the state before the step, whose accelerations were saved with it
+                forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+                    for (GLuint p = begin; p < end; p++) {
+                        positions[p] = savedPositions[p];
+                        velocities[p] = savedVelocities[p];
+                        accelerations[p] = savedAccelerations[p];
+                    }
+                });
+                time = savedTime;
+                elapsed = savedElapsed;
+                adaptiveSize = std::max(lastSize * scale, minH);
+                continue;
+            }
+
+            steps++;
+            // A step cut short to end the frame only says the next may not be longer when its error is too large
+            if (!cut || scale < 1.0f)
+                adaptiveSize = std::min(std::max(lastSize * scale, minH), maxSize);
+            if (lastStep)
+                break;
+        }
+
+        // No particle may move further than cfl times the shortest rest length
+        Real size = adaptiveSize;
+        Real fastest = largestDifference(velocities.data(), nullptr);
+        if (fastest * size > solver.cfl * shortestRestLength)
+            size = std::max(solver.cfl * shortestRestLength / fastest, minH);
+        // The last step takes the rest of the frame, a rest shorter than minH included
+        Real rest = frameTime - elapsed;
+        cut = false;
+        lastStep = size + minH >= rest;
+        if (lastStep) {
+            cut = size > rest;
+            size = rest;
+        }
+
+        forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+            for (GLuint p = begin; p < end; p++) {
+                savedPositions[p] = positions[p];
+                savedVelocities[p] = velocities[p];
+                savedAccelerations[p] = accelerations[p];
+            }
+        });
+        savedTime = time;
+        savedElapsed = elapsed;
+
+        integrate(size);
+        applyTethers();
+        collide();
+        time += size;
+        elapsed += size;
+        lastSize = size;
+        pending = true;
+        forcesValid = false;
+    }
+    PROFILE_COUNT(COUNTER_SUBSTEPS, steps);
+    PROFILE_COUNT(COUNTER_ITERATIONS, iterations);
+}
+
+// Largest length of a[p] - b[p], or of a[p] when b is null, over the particles that are not pinned.
+// A maximum does not depend on the order of the blocks.
+template <typename Real, typename Sum>
+Real BasicWorld<Real, Sum>::largestDifference(const Vec3* a, const Vec3* b) {
+    GLuint particleCount = (GLuint)positions.size();
+    GLuint particleBlocks = (particleCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    ArenaScope scope(scratch);
+    Real* blockLargest = scratch.allocate<Real>(particleBlocks);
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        Real largest = 0.0f;
+        for (GLuint p = begin; p < end; p++) {
+            if (!pinned[p])
+                largest = std::max(largest, glm::length(b ? a[p] - b[p] : a[p]));
+        }
+        blockLargest[begin / BLOCK_SIZE] = largest;
+    });
+    Real largest = 0.0f;
+    for (GLuint block = 0; block < particleBlocks; block++)
+        largest = std::max(largest, blockLargest[block]);
+    return largest;
+}
+
+// The matrix of the implicit and projective steps, M + h b L + h^2 k L with a row of the identity
+// for every pinned particle
+template <typename Real, typename Sum>
+SparseMatrix BasicWorld<Real, Sum>::buildSystemMatrix() {
+    GLuint particleCount = (GLuint)positions.size();
+    Real h = scene.solver.h;
+
+    std::vector<MatrixEntry> entries;
+    entries.reserve(particleCount + 4 * springs.size());
+    for (GLuint p = 0; p < particleCount; p++) {
+        MatrixEntry entry = {p, p, pinned[p] ? 1.0f : (GLfloat)masses[p]};
+        entries.push_back(entry);
+    }
+    for (GLuint s = 0; s < springs.size(); s++) {
+        const Material& material = materials[springs[s].material];
+        GLfloat weight = (GLfloat)(h * material.b + h * h * material.k);
+        GLuint ends[2] = {springs[s].a, springs[s].b};
+        for (GLuint e = 0; e < 2; e++) {
+            GLuint own = ends[e], other = ends[1 - e];
+            if (pinned[own])
+                continue;
+            MatrixEntry diagonal = {own, own, weight};
+            entries.push_back(diagonal);
+            if (!pinned[other]) {
+                MatrixEntry offDiagonal = {own, other, -weight};
+                entries.push_back(offDiagonal);
+            }
+        }
+    }
+
+    return SparseMatrix::fromEntries(particleCount, particleCount, entries);
+}
+
+// Sets up the multigrid hierarchy of the implicit steps over the grids of the cloths
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::buildImplicit() {
+    GLuint particleCount = (GLuint)positions.size();
+    std::vector<GridLayout> grids;
+    for (GLuint c = 0; c < cloths.size(); c++) {
+        GridLayout grid = {cloths[c].firstParticle, cloths[c].width, cloths[c].height};
+        grids.push_back(grid);
+    }
+    multigrid.build(buildSystemMatrix(), grids, std::vector<unsigned char>(pinned.begin(), pinned.end()));
+    implicitRhs.assign(particleCount, glm::vec3(0.0f));
+    velocityChanges.assign(particleCount, glm::vec3(0.0f));
+}
+
+// One backward Euler step from the accelerations of computeForces. The change of the velocities
+// of the last step is the first guess of the solve.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::solveImplicit() {
+    PROFILE_SCOPE(PHASE_INTEGRATE);
+    Real h = scene.solver.h;
+    GLuint particleCount = (GLuint)positions.size();
+
+    // h f - h^2 k L v, the stiffness part of the velocity summed in the particle's spring order
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            if (pinned[p]) {
+                implicitRhs[p] = glm::vec3(0.0f);
+                continue;
+            }
+            SumVec3 stiffness(0.0f);
+            GLuint first = vertexSpringStart[p];
+            for (GLuint n = first; n < first + vertexSpringCount[p]; n++) {
+                const Spring& spring = springs[vertexSprings[n]];
+                GLuint other = spring.a == p ? spring.b : spring.a;
+                stiffness += Real(materials[spring.material].k) * (velocities[p] - velocities[other]);
+            }
+            implicitRhs[p] = glm::vec3(SumVec3(h * masses[p] * accelerations[p]) - Sum(h * h) * stiffness);
+        }
+    });
+
+    iterations += multigrid.solve(implicitRhs.data(), velocityChanges.data(), scene.solver.tolerance,
+                                  scene.solver.maxIterations, scene.solver.multigrid);
+
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            if (!pinned[p]) {
+                velocities[p] += Vec3(velocityChanges[p]);
+                positions[p] += h * velocities[p];
+            }
+        }
+    });
+}
+
+// Factors the matrix of the projective steps
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::buildProjective() {
+    GLuint particleCount = (GLuint)positions.size();
+    cholesky.factor(buildSystemMatrix());
+    previousPositions.assign(particleCount, Vec3(0.0f));
+    springProjections.assign(springs.size(), Vec3(0.0f));
+    inertialRhs.assign(particleCount, Vec3(0.0f));
+    projectiveRhs.assign(particleCount, glm::vec3(0.0f));
+}
+
+// One projective dynamics step. The positions minimise the distance from where the momentum and
+// outer forces take the particles, weighted by the masses, plus the distance of every spring
+// from its rest length, weighted by h^2 k, plus the damping, which is backward Euler on the
+// velocities. Every iteration fixes the directions of the springs at their current ones, which
+// leaves a linear system with the constant matrix M + h b L + h^2 k L. The iterations stop
+// once no particle moves further than tolerance times the largest move of the step.
+//
+// The unknowns are the moves of the step rather than the positions: the rounding of positions
+// far from the origin divided by h would otherwise set a cloth at rest in motion.
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::solveProjective(bool push) {
+    PROFILE_SCOPE(PHASE_INTEGRATE);
+    Real h = scene.solver.h;
+    GLuint particleCount = (GLuint)positions.size();
+    GLuint particleBlocks = (particleCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    // The positions without the springs are the first guess. The momentum and outer forces are
+    // the part of the right hand side the iterations do not change.
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            previousPositions[p] = positions[p];
+            if (pinned[p]) {
+                inertialRhs[p] = Vec3(0.0f);
+                continue;
+            }
+            Vec3 force = Vec3(outerForce(p, push));
+            positions[p] += h * velocities[p] + h * h * inverseMasses[p] * force;
+            inertialRhs[p] = h * masses[p] * velocities[p] + h * h * force;
+        }
+    });
+
+    for (GLuint iteration = 0; iteration < scene.solver.maxIterations; iteration++) {
+        // Local step: every spring at its rest length along its current direction, kept as how
+        // far the spring was at the start of the step from that
+        forEachBlock((GLuint)springs.size(), [&](GLuint begin, GLuint end) {
+            for (GLuint s = begin; s < end; s++) {
+                GLuint a = springs[s].a, b = springs[s].b;
+                Vec3 stretch = positions[a] - positions[b];
+                Real length = glm::length(stretch);
+                Vec3 projection = length > 0.0f ? (restLength(s) / length) * stretch : Vec3(0.0f);
+                springProjections[s] = (previousPositions[a] - previousPositions[b]) - projection;
+            }
+        });
+
+        // Global step, for the moves of the step. The pinned particles do not move.
+        forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+            for (GLuint p = begin; p < end; p++) {
+                if (pinned[p]) {
+                    projectiveRhs[p] = glm::vec3(0.0f);
+                    continue;
+                }
+                SumVec3 sum(inertialRhs[p]);
+                GLuint first = vertexSpringStart[p];
+                for (GLuint n = first; n < first + vertexSpringCount[p]; n++) {
+                    GLuint s = vertexSprings[n];
+                    Sum weight = h * h * materials[springs[s].material].k;
+                    sum -= (springs[s].a == p ? weight : -weight) * SumVec3(springProjections[s]);
+                }
+                projectiveRhs[p] = glm::vec3(sum);
+            }
+        });
+        cholesky.solve(projectiveRhs.data(), projectiveRhs.data());
+        iterations++;
+
+        // The largest move of a particle in this iteration and in the whole step, maxima do not
+        // depend on the order of the blocks
+        ArenaScope scope(scratch);
+        Real* blockMoves = scratch.allocate<Real>(2 * particleBlocks);
+        forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+            Real move = 0.0f, stepMove = 0.0f;
+            for (GLuint p = begin; p < end; p++) {
+                Vec3 stepMoved(projectiveRhs[p]);
+                Vec3 position = previousPositions[p] + stepMoved;
+                move = std::max(move, glm::length(position - positions[p]));
+                stepMove = std::max(stepMove, glm::length(stepMoved));
+                positions[p] = position;
+            }
+            blockMoves[2 * (begin / BLOCK_SIZE)] = move;
+            blockMoves[2 * (begin / BLOCK_SIZE) + 1] = stepMove;
+        });
+        Real move = 0.0f, stepMove = 0.0f;
+        for (GLuint b = 0; b < particleBlocks; b++) {
+            move = std::max(move, blockMoves[2 * b]);
+            stepMove = std::max(stepMove, blockMoves[2 * b + 1]);
+        }
+        if (move <= scene.solver.tolerance * stepMove)
+            break;
+    }
+
+    forEachBlock(particleCount, [&](GLuint begin, GLuint end) {
+        for (GLuint p = begin; p < end; p++) {
+            if (!pinned[p])
+                velocities[p] = Vec3(projectiveRhs[p]) / h;
+        }
+    });
+}
+
+// Moves particles that ended up inside a collider back to its surface and removes the
+// part of their velocity going into it
+template <typename Real, typename Sum>
+void BasicWorld<Real, Sum>::collide() {
+    PROFILE_SCOPE(PHASE_COLLIDE);
+    for (GLuint c = 0; c < scene.colliders.size(); c++) {
+        const Collider& collider = scene.colliders[c];
+
+        forEachBlock((GLuint)positions.size(), [&](GLuint begin, GLuint end) {
+            for (GLuint p = begin; p < end; p++) {
+                if (pinned[p])
+                    continue;
+
+                Vec3 position = positions[p];
+                Vec3 normal;
+                Real depth;
+
+                if (collider.type == COLLIDER_SPHERE) {
+                    Vec3 fromCenter = position - Vec3(collider.center);
+                    Real distance = glm::length(fromCenter);
+                    if (distance >= collider.radius || distance == 0.0f)
+                        continue;
+                    normal = fromCenter / distance;
+                    depth = collider.radius - distance;
+                } else {
+                    normal = Vec3(collider.normal);
+                    depth = collider.offset - glm::dot(normal, position);
+                    if (depth <= 0.0f)
+                        continue;
+                }
+
+                positions[p] = position + depth * normal;
+                Vec3 velocity = velocities[p];
+                Real inwards = glm::dot(velocity, normal);
+                if (inwards < 0.0f)
+                    velocities[p] = velocity - inwards * normal;
+            }
+        });
+    }
+}
+
+// Calculates the spring force acting on a particle
+template <typename Real>
+static glm::tvec3<Real, glm::highp> theSpringForce(glm::tvec3<Real, glm::highp> p1, glm::tvec3<Real, glm::highp> p2,
+                                                   Real L0, Real k){
+    Real lengthBParticles = std::sqrt(Real(pow(p2.x-p1.x,2) + pow(p2.y-p1.y,2) + pow(p2.z-p1.z,2)));
+    glm::tvec3<Real, glm::highp> length = p2 - p1;
+
+    glm::tvec3<Real, glm::highp> Fk = k*(lengthBParticles-L0)*(normalize(length));
+    return Fk;
+}
+
+// Calculates the damping force acting on a particle
+template <typename Real>
+static glm::tvec3<Real, glm::highp> theDampForce(glm::tvec3<Real, glm::highp> v1, glm::tvec3<Real, glm::highp> v2, Real b){
+    glm::tvec3<Real, glm::highp> Fb = b * (v1 - v2);
+    return Fb;
+}
+
+// Force on each vertex of the triangles [begin, end) from the air moving past them. With N the
+// cross product of the two edges (twice the area along the normal) and v the wind relative to the
+// triangle, drag is dragFactor |N.v| v and lift is liftFactor (N.v) (|v|^2 N - (N.v) v) / (|N| |v|),
+// which needs no normalised vectors. The loop only reads and writes consecutive elements and has
+// no branches, so the compiler vectorises it.
+template <typename Real>
+static void aerodynamicForces(GLuint begin, GLuint end, const Real* e1x, const Real* e1y, const Real* e1z,
+                              const Real* e2x, const Real* e2y, const Real* e2z,
+                              const Real* rx, const Real* ry, const Real* rz,
+                              Real dragFactor, Real liftFactor, Real* fx, Real* fy, Real* fz) {
+    for (GLuint t = begin; t < end; t++) {
+        Real nx = e1y[t] * e2z[t] - e1z[t] * e2y[t];
+        Real ny = e1z[t] * e2x[t] - e1x[t] * e2z[t];
+        Real nz = e1x[t] * e2y[t] - e1y[t] * e2x[t];
+
+        Real nDotR = nx * rx[t] + ny * ry[t] + nz * rz[t];
+        Real nn = nx * nx + ny * ny + nz * nz;
+        Real rr = rx[t] * rx[t] + ry[t] * ry[t] + rz[t] * rz[t];
+        Real drag = dragFactor * std::fabs(nDotR);
+        Real lift = liftFactor * nDotR / std::sqrt(nn * rr + Real(1e-30f));
+
+        fx[t] = drag * rx[t] + lift * (rr * nx - nDotR * rx[t]);
+        fy[t] = drag * ry[t] + lift * (rr * ny - nDotR * ry[t]);
+        fz[t] = drag * rz[t] + lift * (rr * nz - nDotR * rz[t]);
+    }
+}
+
+// Calculate the new velocity using RK4
+template <typename Real>
+static glm::tvec3<Real, glm::highp> RungeKuttaForVel(glm::tvec3<Real, glm::highp> velocity,
+                                                     glm::tvec3<Real, glm::highp> acceleration, Real h){
+    glm::tvec3<Real, glm::highp> next, k1, k2, k3, k4;
+
+    k1 = acceleration;
+    k2 = acceleration + (h/Real(2))*k1;
+    k3 = acceleration + (h/Real(2))*k2;
+    k4 = acceleration + h*k3;
+    next = velocity + (h/Real(6))*(k1 + Real(2)*k2 + Real(2)*k3 + k4);
+
+    return next;
+}
+
+// Calculate the difference between the new position and the old one using RK4
+template <typename Real>
+static glm::tvec3<Real, glm::highp> RungeKuttaForPosDiff(glm::tvec3<Real, glm::highp> velocity, Real h){
+    glm::tvec3<Real, glm::highp> next, k1, k2, k3, k4;
+    k1 = velocity;
+    k2 = velocity + (h/Real(2))*k1;
+    k3 = velocity + (h/Real(2))*k2;
+    k4 = velocity + h*k3;
+    next = (h/Real(6))*(k1 + Real(2)*k2 + Real(2)*k3 + k4);
+    return next;
+}
+
+World::~World() {}
+
+// The precisions a scene can choose
+template class BasicWorld<GLfloat, GLfloat>;
+template class BasicWorld<GLdouble, GLdouble>;
+template class BasicWorld<GLfloat, GLdouble>;
+
+std::unique_ptr<World> World::create(const Scene& scene) {
+    switch (scene.solver.precision) {
+        case PRECISION_DOUBLE:
+            return std::unique_ptr<World>(new BasicWorld<GLdouble, GLdouble>(scene));
+        case PRECISION_MIXED:
+            return std::unique_ptr<World>(new BasicWorld<GLfloat, GLdouble>(scene));
+        default:
+            return std::unique_ptr<World>(new BasicWorld<GLfloat, GLfloat>(scene));
+    }
+}
+
+std::unique_ptr<World> World::create(const Scene& scene, GLuint firstRow, GLuint rowCount) {
+    switch (scene.solver.precision) {
+        case PRECISION_DOUBLE:
+            return std::unique_ptr<World>(new BasicWorld<GLdouble, GLdouble>(scene, firstRow, rowCount));
+        case PRECISION_MIXED:
+            return std::unique_ptr<World>(new BasicWorld<GLfloat, GLdouble>(scene, firstRow, rowCount));
+        default:
+            return std::unique_ptr<World>(new BasicWorld<GLfloat, GLfloat>(scene, firstRow, rowCount));
+    }
+}